@@ -9,7 +9,12 @@ class AdaGradOptimizer: public Optimizer{
 public:
     AdaGradOptimizer() = default;
     AdaGradOptimizer(float learning_rate, vector<float> decay_locs);
-    virtual void optimize(const shared_ptr<Chunk>& param, int iter);
+    virtual void prepare(const shared_ptr<Chunk>& param);
+protected:
+    virtual StepHps resolve(int iter);
+    virtual StepBuffers buffers(const shared_ptr<Chunk>& param);
+    virtual void update(const StepHps& hps, const StepBuffers& buffers, int begin, int end);
+
 private:
     map<Chunk*, Chunk> accumulate_squared_gradient_;
 };
@@ -1,6 +1,7 @@
 #ifndef ADAMOPTIMIZER_H
 #define ADAMOPTIMIZER_H
 #include <map>
+#include <string>
 #include "optimizer.h"
 
 namespace micronet {
@@ -8,12 +9,35 @@ namespace micronet {
 class AdamOptimizer: public Optimizer{
 public:
     AdamOptimizer() = default;
-    AdamOptimizer(float learning_rate, vector<float> decay_locs, float decay_rate_1 = 0.9, float decay_rate_2 = 0.999);
-    virtual void optimize(const shared_ptr<Chunk>& param, int iter);
+    // state_precision "fp32", or "bf16" / "int8" for compact moments
+    AdamOptimizer(float learning_rate, vector<float> decay_locs, float decay_rate_1 = 0.9, float decay_rate_2 = 0.999,
+                  const string& state_precision = "fp32");
+    virtual void prepare(const shared_ptr<Chunk>& param);
+    virtual void begin_iter(int iter);
+
+protected:
+    virtual StepHps resolve(int iter);
+    virtual StepBuffers buffers(const shared_ptr<Chunk>& param);
+    virtual void update(const StepHps& hps, const StepBuffers& buffers, int begin, int end);
 
 private:
+    // moments of one param in bf16, or in int8 with a scale per STATE_BLOCK
+    // values, the second moment is kept as its square root
+    struct CompactMoments {
+        shared_ptr<vector<float>> holder;
+        int value_bytes;
+        int offset;
+        char* values[2];
+        float* scales[2];
+    };
+    string state_precision() const;
+    CompactMoments new_compact_moments(int count) const;
+    CompactMoments& compact_state(const shared_ptr<Chunk>& param);
+    void compact_update(const StepHps& hps, const StepBuffers& buffers, int begin, int end);
+
     map<Chunk*, Chunk> first_moment_estimate_;
     map<Chunk*, Chunk> second_moment_estimate_;
+    map<Chunk*, CompactMoments> compact_moments_;
 };
 } // namespace micronet
 
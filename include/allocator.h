@@ -0,0 +1,33 @@
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+#include <vector>
+#include <cstddef>
+
+using namespace std;
+
+namespace micronet {
+
+// Buffers of at least HUGE_PAGE_BYTES are huge page aligned, padded to whole
+// huge pages and advised as transparent huge pages.
+const size_t HUGE_PAGE_BYTES = size_t(2) << 20;
+
+// first_touch leaves a page on the node of the thread that first writes it,
+// Chunk zero fills large buffers with the pool so pages follow the workers.
+// interleave spreads large buffers round robin over all NUMA nodes.
+// MICRONET_MEMORY_POLICY=interleave and MICRONET_HUGE_PAGES=0 set the defaults.
+enum class MemoryPolicy {first_touch, interleave};
+
+void set_memory_policy(MemoryPolicy policy);
+MemoryPolicy get_memory_policy();
+void set_huge_pages(bool enable);
+bool get_huge_pages();
+
+float* allocate_floats(size_t count);
+void free_floats(float* buffer);
+
+// online NUMA nodes and their cores, a single node when there is no sysfs
+vector<vector<int>> numa_node_cores();
+
+} // namespace micronet
+
+#endif // ALLOCATOR_H
@@ -0,0 +1,60 @@
+#ifndef BINARYMODEL_H
+#define BINARYMODEL_H
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+#include "nlohmann/json.hpp"
+
+using namespace std;
+using json = nlohmann::json;
+
+namespace micronet {
+
+// Binary model layout: "MICRONET", uint32 version, uint32 reserved, uint64 header
+// size, the json graph header, then every param blob aligned to BLOB_ALIGNMENT.
+// Param "offset"s in the header are relative to the first blob.
+const int BLOB_ALIGNMENT = 64;
+
+struct ParamBlob {
+    const float* data;
+    size_t count;
+};
+
+// Private copy-on-write mapping of a whole file, unmapped when the last chunk
+// sharing it goes away. Untouched pages stay shared through the page cache.
+class MappedFile {
+public:
+    explicit MappedFile(const string& filename);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    char* data() const {return data_;};
+    size_t size() const {return size_;};
+
+private:
+    char* data_;
+    size_t size_;
+};
+
+// blob offsets are checked against size, the bytes readable from base
+struct BlobSource {
+    const char* base;
+    shared_ptr<void> holder;
+    size_t size;
+};
+
+uint16_t float_to_half(float value);
+float half_to_float(uint16_t value);
+
+void assign_blob_offsets(json& j_net, const vector<size_t>& counts, bool fp16);
+// returns false after an I/O error, the file is then incomplete
+bool write_binary_model(const string& save_path, const json& j_net, const vector<ParamBlob>& blobs,
+                        bool fp16, bool sync = false);
+json read_binary_header(const MappedFile& file, size_t& blobs_offset);
+
+} // namespace micronet
+
+#endif // BINARYMODEL_H
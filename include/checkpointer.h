@@ -0,0 +1,58 @@
+#ifndef CHECKPOINTER_H
+#define CHECKPOINTER_H
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "nlohmann/json.hpp"
+#include "binarymodel.h"
+
+using namespace std;
+using json = nlohmann::json;
+
+namespace micronet {
+
+class Net;
+
+// Periodic binary checkpoints written off the training thread. save() only
+// copies the params into one of two snapshot buffers; a background thread
+// serializes, fsyncs and renames the file, keeping the newest max_to_keep.
+class Checkpointer {
+public:
+    Checkpointer(Net* net, const string& path_prefix, int max_to_keep = 3, bool fp16 = false);
+    ~Checkpointer();
+    void save(int iter);
+    void wait();
+    deque<string> saved_paths() const;
+
+private:
+    struct Snapshot {
+        json header;
+        vector<float> data;
+        vector<ParamBlob> blobs;
+        string path;
+    };
+    void write_loop();
+    bool write_snapshot(Snapshot& snapshot);
+
+    Net* net_;
+    string path_prefix_;
+    int max_to_keep_;
+    bool fp16_;
+
+    Snapshot snapshots_[2];
+    bool busy_[2];
+    deque<int> pending_;
+    deque<string> saved_paths_;
+    bool stop_;
+    mutable mutex mutex_;
+    condition_variable cond_;
+    thread writer_;
+};
+
+} // namespace micronet
+
+#endif // CHECKPOINTER_H
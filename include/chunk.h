@@ -33,6 +33,11 @@ public:
     void copy_from(const Chunk& source);
     void fill_value(const float data_value, const float diff_value);
 
+    void share_data(float* data, const shared_ptr<void>& holder);
+    void share_diff(float* diff, const shared_ptr<void>& holder);
+    bool owns_data() const {return data_holder_ == nullptr;};
+    bool owns_diff() const {return diff_holder_ == nullptr;};
+
     const float* const_data() const;
     const float* const_diff() const;
     float* data();
@@ -65,9 +70,8 @@ private:
     //shared_ptr<vector<float> > diff_;
     float* data_;
     float* diff_;
+    shared_ptr<void> data_holder_, diff_holder_;
     bool trainable_ = true;
-
-    friend shared_ptr<Chunk> parse_param(const json& j_param, map<string, shared_ptr<Chunk>>& params);
 };
 
 } // namespace micronet
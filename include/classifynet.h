@@ -14,9 +14,11 @@ public:
                          const string& net_name="ClassifyNet");
 
     virtual void fit(const map<string, data_t>& train_data, const map<string, data_t>& valid_data,
-                     int batch_size, int epochs, int verbose=100, bool shuffle=true) override;
+                     int batch_size, int epochs, int verbose=100, bool shuffle=true,
+                     int accumulation_steps=1) override;
     virtual void evaluate(const map<string, data_t>& data, int batch_size) override;
     virtual data_t inference(const map<string, data_t>& data, int batch_size) override;
+    using Net::inference;
 
 protected:
     virtual void forward(bool is_train, const string& layer_prefix = "") override;
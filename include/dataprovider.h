@@ -7,8 +7,10 @@
 #include <chrono>
 #include <algorithm>
 #include <memory>
+#include <random>
 
 #include "chunk.h"
+#include "transform.h"
 
 using namespace std;
 
@@ -17,18 +19,43 @@ namespace micronet {
 using data_t = vector<vector<float>>;
 using chunk_ptr = shared_ptr<Chunk>;
 
+// Describes how the i-th loaded chunk is derived: samples of data_vec[source]
+// with shape {c, h, w} passed through transforms in order.
+struct DataStage {
+    int source;
+    vector<int> shape;
+    vector<transform_ptr> transforms;
+};
+
+// Samples taken off a provider and their augmentation seeds.
+struct Batch {
+    vector<int> samples;
+    vector<unsigned> seeds;
+};
 
 class DataProvider {
 public:
     DataProvider(vector<data_t>& data_vec, bool shuffle = true);
+    DataProvider(vector<data_t>& data_vec, const vector<DataStage>& stages, bool shuffle = true, bool augment = true);
     void load_batch(const vector<chunk_ptr>& chunks_in, int batch_size);
+    // next_batch advances the provider and has to be serialized, loading a
+    // batch taken before only reads the samples and may run concurrently
+    void next_batch(int batch_size, Batch& batch);
+    void load_batch(const vector<chunk_ptr>& chunks_in, const Batch& batch) const;
     inline int num_samples() {return num_samples_;};
 private:
     void shuffle_data();
+    void load_stage(const chunk_ptr& chunk, const DataStage& stage, const Batch& batch) const;
     vector<data_t> data_vec_;
+    // shuffling permutes the order, the samples never move
+    vector<DataStage> stages_;
     bool shuffle_;
+    bool augment_;
     int index_in_epoch_;
     int num_samples_;
+    vector<int> order_;
+    Batch batch_;
+    default_random_engine seed_generator_;
 };
 } //namespace micronet
 
@@ -0,0 +1,20 @@
+#ifndef JSONMODEL_H
+#define JSONMODEL_H
+#include <string>
+
+#include "nlohmann/json.hpp"
+#include "binarymodel.h"
+
+using namespace std;
+using json = nlohmann::json;
+
+namespace micronet {
+
+// Streams a json model through the SAX parser. Param "data" arrays never become
+// json values: their floats go straight into one arena, and the params get fp32
+// "offset"s into it like a binary header, so from_json can share the arena.
+json read_json_model(const string& save_path, BlobSource& blobs);
+
+} // namespace micronet
+
+#endif // JSONMODEL_H
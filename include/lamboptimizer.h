@@ -0,0 +1,33 @@
+#ifndef LAMBOPTIMIZER_H
+#define LAMBOPTIMIZER_H
+#include <map>
+#include "optimizer.h"
+
+namespace micronet {
+
+// Adam with decoupled weight decay where every param's step is scaled by
+// |w| / |update|, for large batches.
+class LAMBOptimizer: public Optimizer {
+public:
+    LAMBOptimizer() = default;
+    LAMBOptimizer(float learning_rate, vector<float> decay_locs, float decay_rate_1 = 0.9,
+                  float decay_rate_2 = 0.999, float weight_decay = 0.01);
+    virtual void prepare(const shared_ptr<Chunk>& param);
+    virtual void begin_iter(int iter);
+    virtual bool layer_wise() const {return true;};
+
+protected:
+    virtual StepHps resolve(int iter);
+    virtual StepBuffers buffers(const shared_ptr<Chunk>& param);
+    virtual void update(const StepHps& hps, const StepBuffers& buffers, int begin, int end);
+    virtual void accumulate_norms(const StepHps& hps, const StepBuffers& buffers, int begin, int end,
+                                  double& weight_norm, double& update_norm);
+    virtual float trust_ratio(const StepHps& hps, double weight_norm, double update_norm);
+
+private:
+    map<Chunk*, Chunk> first_moment_estimate_;
+    map<Chunk*, Chunk> second_moment_estimate_;
+};
+} // namespace micronet
+
+#endif // LAMBOPTIMIZER_H
@@ -0,0 +1,31 @@
+#ifndef LARSOPTIMIZER_H
+#define LARSOPTIMIZER_H
+#include <map>
+#include "optimizer.h"
+
+namespace micronet {
+
+// SGD with momentum where every param's learning rate is scaled by
+// trust_coefficient * |w| / (|g| + weight_decay * |w|), for large batches.
+class LARSOptimizer: public Optimizer {
+public:
+    LARSOptimizer() = default;
+    LARSOptimizer(float learning_rate, vector<float> decay_locs, float momentum = 0.9,
+                  float weight_decay = 0.0005, float trust_coefficient = 0.001);
+    virtual void prepare(const shared_ptr<Chunk>& param);
+    virtual bool layer_wise() const {return true;};
+
+protected:
+    virtual StepHps resolve(int iter);
+    virtual StepBuffers buffers(const shared_ptr<Chunk>& param);
+    virtual void update(const StepHps& hps, const StepBuffers& buffers, int begin, int end);
+    virtual void accumulate_norms(const StepHps& hps, const StepBuffers& buffers, int begin, int end,
+                                  double& weight_norm, double& update_norm);
+    virtual float trust_ratio(const StepHps& hps, double weight_norm, double update_norm);
+
+private:
+    map<Chunk*, Chunk> param_velocity_;
+};
+} // namespace micronet
+
+#endif // LARSOPTIMIZER_H
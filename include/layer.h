@@ -5,6 +5,7 @@
 #include <string>
 #include <iostream>
 #include <map>
+#include <functional>
 
 #include "nlohmann/json.hpp"
 #include "chunk.h"
@@ -20,7 +21,18 @@ namespace micronet {
 
 using chunk_ptr = shared_ptr<Chunk>;
 
+// Param initialization recorded at graph construction and run later by
+// Net::materialize_params, so nets that load weights never pay for it.
+struct ParamInit {
+    chunk_ptr param;
+    string init_type; // "normal" or "constant"
+    float value1, value2;
+    int seed;
+};
+
 class Net;
+class TaskGroup;
+struct BlobSource;
 
 class Layer {
 public:
@@ -33,8 +45,16 @@ public:
 protected:
     virtual vector<int> shape_inference() = 0;
     void gradient_reset();
+    void defer_init(int index, const string& init_type, float value1, float value2 = 0.0f);
+    // Backward work no earlier layer waits for, i.e. the param gradients. It
+    // runs on tasks next to the input gradient, or is left to the executor
+    // to run next to the earlier layers' backward once backward returned.
+    void run_param_grads(TaskGroup& tasks, function<void()> task);
     vector<chunk_ptr> params_;
+    vector<ParamInit> param_inits_;
     vector<chunk_ptr> chunks_in_, chunks_out_;
+    vector<function<void()>> param_grads_;
+    bool collect_param_grads_ = false;
     string layer_name_;
     string layer_type_;
 
@@ -47,9 +67,10 @@ protected:
     friend class GanNet;
     friend class GanNet2;
     friend class RegressionNet;
-    friend shared_ptr<Layer> parse_layer(const json& j_layer, map<string, shared_ptr<Chunk>>& params);
-    friend void to_json(json& j_net, Net* net);
-    friend void from_json(const json& j_net, Net* net);
+    friend shared_ptr<Layer> parse_layer(const json& j_layer, map<string, shared_ptr<Chunk>>& params,
+                                         const BlobSource* blobs);
+    friend void to_json(json& j_net, Net* net, bool with_data);
+    friend void from_json(const json& j_net, Net* net, const BlobSource* blobs);
     friend void add_layer_prefix(const chunk_ptr& in, const chunk_ptr& out, const string& suffix);
     friend void add_layer_prefix2(const chunk_ptr& in, const chunk_ptr& out, const string& suffix);
     friend void share_parameters(const chunk_ptr& in, const chunk_ptr& out, const string& layer_space_name);
@@ -19,6 +19,11 @@ void mat_mul4(int n_a_rows, int n_a_cols, const float* a, int n_b_cols, const fl
 #endif // __SSE__
 void mat_mul5(int n_a_rows, int n_a_cols, const float* a, int n_b_cols, const float* b, float* c, float alpha);
 
+// y = x * w + bias for a few rows of x (M <= GEMV_MAX_BATCH), w is K x N.
+// Each column strip of w is streamed once for all rows, no transpose.
+const int GEMV_MAX_BATCH = 4;
+void batched_gemv(int M, int N, int K, const float* x, const float* w, const float* bias, float* y);
+
 void matmul_nn(int M, int N, int K, float ALPHA,
                const float* A, int lda, const float* B, int ldb,
                float* C, int ldc);
@@ -23,6 +23,8 @@
 #include "adagradoptimizer.h"
 #include "rmsproboptimizer.h"
 #include "adamoptimizer.h"
+#include "larsoptimizer.h"
+#include "lamboptimizer.h"
 #include "add.h"
 #include "math_func.h"
 #include "classifynet.h"
@@ -36,6 +38,11 @@
 #include "pixelshuffle.h"
 #include "instancenormalization.h"
 #include "regressionnet.h"
+#include "transform.h"
+#include "binarymodel.h"
+#include "jsonmodel.h"
+#include "checkpointer.h"
+#include "threadpool.h"
 
 
 #endif // MICRONET_H_INCLUDED
@@ -10,12 +10,15 @@
 #include <queue>
 #include <iomanip>
 #include <fstream>
+#include <functional>
 
 #include "nlohmann/json.hpp"
 #include "layer.h"
 #include "chunk.h"
 #include "sgdoptimizer.h"
 #include "dataprovider.h"
+#include "checkpointer.h"
+#include "processgroup.h"
 #include "util.h"
 
 using json = nlohmann::json;
@@ -24,6 +27,7 @@ namespace micronet {
 
 
 using data_t = vector<vector<float>>;
+using layer_filter = function<bool(const layer_ptr&)>;
 
 extern map<string, vector<Layer*>> layer_space;
 
@@ -33,6 +37,16 @@ struct layer_compare {
     }
 };
 
+// Throughput and staleness of the last hogwild epoch. The staleness of an
+// update is the number of updates other workers applied between its forward
+// pass reading the params and the update itself.
+struct HogwildStats {
+    int updates = 0;
+    double samples_per_second = 0;
+    double mean_staleness = 0;
+    int max_staleness = 0;
+};
+
 void add_layer_prefix(const chunk_ptr& in, const chunk_ptr& out, const string& prefix);
 void share_parameters(const chunk_ptr& in, const chunk_ptr& out, const string& layer_space_name);
 
@@ -43,12 +57,38 @@ public:
     void set_optimizer(const shared_ptr<Optimizer>& optimizer);
 
     virtual void fit(const map<string, data_t>& train_data, const map<string, data_t>& valid_data,
-                     int batch_size, int epochs, int verbose=100, bool shuffle=true) = 0;
+                     int batch_size, int epochs, int verbose=100, bool shuffle=true,
+                     int accumulation_steps=1) = 0;
     virtual void evaluate(const map<string, data_t>& data, int batch_size) = 0;
     virtual data_t inference(const map<string, data_t>& data, int batch_size) = 0;
+    void inference(const string& input_key, const float* input, const vector<int>& input_shape,
+                   const string& output_key, float* output);
+
+    void set_transforms(const string& key, const string& source, const vector<int>& source_shape,
+                        const vector<transform_ptr>& transforms);
 
     void save_model(const string& save_path);
     void load_model(const string& save_path);
+    void save_binary_model(const string& save_path, bool fp16 = false);
+    void load_binary_model(const string& save_path);
+    void set_checkpointer(const shared_ptr<Checkpointer>& checkpointer, int interval);
+    void autotune(int batch_size, vector<int> thread_counts = {}, int repeats = 5);
+    // split every train batch over num_replicas copies of the net
+    void set_replicas(int num_replicas);
+    // split the layers into num_stages pipeline stages, each on its own group
+    // of cores, and stream each train batch through them as num_micro_batches
+    // micro batches
+    void set_pipeline(int num_stages, int num_micro_batches);
+    // train with num_workers replicas that update the shared params without locks
+    void set_hogwild(int num_workers);
+    const HogwildStats& hogwild_stats() const {return hogwild_stats_;};
+    // average gradients with the other ranks of group after every backward,
+    // fit trains on this rank's shard and only rank 0 writes checkpoints.
+    // Hogwild ranks average their params at the end of every epoch instead.
+    void set_process_group(const shared_ptr<ProcessGroup>& group);
+    // run the optimizer on a layer's params inside the backward pass, as soon
+    // as their diffs are final, on by default
+    void set_overlap_update(bool overlap) {overlap_update_ = overlap;};
 
     void print_net();
 
@@ -58,24 +98,86 @@ protected:
     virtual void backward(const string& layer_prefix = "") = 0;
     virtual void update(const string& layer_prefix = "") = 0;
 
+    const vector<layer_ptr>& inference_sequence(const string& output_key);
+    void forward_inference(const string& output_key);
+
+    void build_schedule();
+    void execute_forward(bool is_train, const layer_filter& filter = nullptr);
+    void execute_backward(const layer_filter& filter = nullptr);
+    void execute(bool is_backward, bool is_train, const layer_filter& filter, bool update_params = false);
+    int tuned_threads(const string& layer_name, int batch_size);
+
+    vector<chunk_ptr> unique_params();
+    void materialize_params();
+    void pack_params();
+    void reset_param_diffs();
+    void step_arena();
+    bool checkpoint_due(int iter) const;
+    void checkpoint_step();
+    void train_step();
+    void train_step(DataProvider& train, int batch_size, int accumulation_steps);
+    void accumulate(int accumulation_steps, const function<void(int)>& micro_step);
+    void forward_backward(bool accumulate = false);
+    void replica_forward_backward(bool accumulate = false);
+    vector<int> pipeline_partition(int num_stages);
+    void pipeline_forward_backward(int num_micro_batches);
+    void broadcast_params();
+    void exchange_gradients();
+    void build_replicas();
+    map<string, float> hogwild_epoch(DataProvider& train, int batch_size, int steps);
+
+    bool has_data(const map<string, data_t>& data, const string& key);
+    shared_ptr<DataProvider> make_provider(const map<string, data_t>& data, const vector<string>& keys,
+                                           bool shuffle, bool augment, bool shard = false);
+
     set<layer_ptr, layer_compare> all_layers_;
     map<layer_ptr, vector<layer_ptr>, layer_compare> net_graph_;
     vector<layer_ptr> net_sequences_;
 
     map<string, chunk_ptr> key_chunks_;
     vector<chunk_ptr> inputs_;
+    map<string, pair<string, DataStage>> input_stages_;
     shared_ptr<Optimizer> optimizer_;
+    shared_ptr<Checkpointer> checkpointer_;
+    int checkpoint_interval_ = 0;
+
+    map<string, vector<layer_ptr>> inference_sequences_;
+    // successors by index into net_sequences_, backward also chains layers
+    // that accumulate into the same input diff or param diff
+    vector<vector<int>> forward_next_, backward_next_;
+
+    // the trainable params and their diffs packed into one buffer, every param
+    // is a view at its offset
+    shared_ptr<Chunk> param_arena_;
+    vector<pair<chunk_ptr, int>> arena_params_;
 
     map<string, pair<double, double>> layer_op_time_;
     map<string, double> layer_up_time_;
+    // layer name -> batch size -> best thread count, filled by autotune
+    map<string, map<int, int>> layer_threads_;
+
+    // replicas share the trainable params of this net and keep their own
+    // activations, diffs and batch statistics
+    int num_replicas_ = 1;
+    vector<shared_ptr<Net>> replicas_;
+    vector<pair<chunk_ptr, vector<chunk_ptr>>> replica_params_;
+    int pipeline_stages_ = 1;
+    vector<vector<int>> pipeline_cores_;
+    bool overlap_update_ = true;
+    bool hogwild_ = false;
+    HogwildStats hogwild_stats_;
+    shared_ptr<ProcessGroup> process_group_;
+    bool group_synced_ = false;
 
     string net_name_;
     int iter_;
 
     bool net_initialized_ = false;
+    bool params_materialized_ = false;
 
-    friend void to_json(json& j_net, Net* net);
-    friend void from_json(const json& j_net, Net* net);
+    friend void to_json(json& j_net, Net* net, bool with_data);
+    friend void from_json(const json& j_net, Net* net, const BlobSource* blobs);
+    friend class Checkpointer;
 };
 } // namespace micronet
 
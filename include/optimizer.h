@@ -14,25 +14,83 @@ namespace micronet {
 
 class Net;
 
+// Optimizer state quantized per block keeps one scale for this many values,
+// element ranges handed to update() start on a block.
+const int STATE_BLOCK = 64;
+
 class Optimizer {
 public:
     Optimizer() = default;
     Optimizer(const string& optimizer_type, vector<float> decay_locs);
     virtual ~Optimizer(){};
-    virtual void optimize(const shared_ptr<Chunk>& param, int iter) = 0;
+    virtual void optimize(const shared_ptr<Chunk>& param, int iter);
+    // updates all params in one parallel pass over their elements, with the
+    // hyper params of iter resolved once
+    void step(const vector<shared_ptr<Chunk>>& params, int iter);
+    // creates the state of param up front, so threads optimizing different
+    // params never insert into the state maps at the same time
+    virtual void prepare(const shared_ptr<Chunk>& param) {};
+    // per iteration state, run once before the params of iter are optimized
+    virtual void begin_iter(int iter) {};
+    // scales every param's update by a trust ratio from the norms of the param,
+    // so params must be stepped one by one instead of packed together
+    virtual bool layer_wise() const {return false;};
+    // optimize(copy) reads and updates the state of param
+    void share_state(const shared_ptr<Chunk>& copy, const shared_ptr<Chunk>& param);
+    // params packed into arena at the given offsets keep their state at the
+    // same offsets of the arena's state, so optimizing the arena in one call
+    // or the params one by one reads and writes the same state
+    void pack_state(const shared_ptr<Chunk>& arena, const vector<pair<shared_ptr<Chunk>, int>>& params);
     int total_iters_;
 
 protected:
+    // hyper params of one step, the rates are the optimizer's decay rates or momentum
+    struct StepHps {
+        float learning_rate;
+        float rate_1, rate_2;
+        // layer-wise optimizers, the rest stay 0
+        float weight_decay, trust_coefficient;
+        float correction_1, correction_2;
+    };
+    // the buffers of one param in a step, up to two state buffers
+    struct StepBuffers {
+        float* data;
+        const float* diff;
+        float* state[2];
+        // compact state, bf16 or int8 values and for int8 a scale per STATE_BLOCK values
+        void* packed_state[2];
+        float* state_scales[2];
+        // layer-wise optimizers, 1 otherwise
+        float trust_ratio;
+        // offset of the compact state in its arena, seeds its rounding noise
+        int state_offset;
+    };
+    virtual StepHps resolve(int iter) = 0;
+    virtual StepBuffers buffers(const shared_ptr<Chunk>& param) = 0;
+    // updates elements [begin, end) of one param
+    virtual void update(const StepHps& hps, const StepBuffers& buffers, int begin, int end) = 0;
+    // layer-wise optimizers: adds the squared norms of the weights and of the
+    // update direction over [begin, end), then turns a param's norms into its trust ratio
+    virtual void accumulate_norms(const StepHps& hps, const StepBuffers& buffers, int begin, int end,
+                                  double& weight_norm, double& update_norm) {};
+    virtual float trust_ratio(const StepHps& hps, double weight_norm, double update_norm) {return 1;};
+    float decayed_learning_rate(int iter) const;
+
+    Chunk* state_key(const shared_ptr<Chunk>& param) const;
+    Chunk& state(map<Chunk*, Chunk>& states, const shared_ptr<Chunk>& param);
+
     string optimizer_type_;
     vector<float> decay_locs_;
     map<string, string> str_hps_;
     map<string, float> flt_hps_;
     map<string, int> int_hps_;
+    map<Chunk*, Chunk*> state_aliases_;
+    map<Chunk*, pair<Chunk*, int>> state_views_;
 
     friend class Net;
 
     friend shared_ptr<Optimizer> parse_optimizer(const json& j_optimizer);
-    friend void to_json(json& j_net, Net* net);
+    friend void to_json(json& j_net, Net* net, bool with_data);
 };
 } // namespace micronet
 
@@ -0,0 +1,55 @@
+#ifndef PROCESSGROUP_H
+#define PROCESSGROUP_H
+#include <vector>
+#include <memory>
+#include <utility>
+#include <cstddef>
+#include <sys/types.h>
+
+using namespace std;
+
+namespace micronet {
+
+// Training processes on one host exchanging data through POSIX shared memory.
+// Every rank owns a slot of slot_floats floats, buffers larger than a slot go
+// through in pieces. all_reduce_mean is a reduce-scatter, each rank averages
+// its share of the piece over all slots in rank order, followed by an
+// all-gather, so every rank ends up with bitwise identical values.
+class ProcessGroup {
+public:
+    // Forks world_size - 1 children, each process returns with its own rank.
+    // Must run before the thread pool starts, i.e. before any net is built.
+    // Each rank is pinned to NUMA node rank % num_nodes.
+    static shared_ptr<ProcessGroup> launch(int world_size, size_t slot_floats = size_t(1) << 20);
+    ~ProcessGroup();
+    ProcessGroup(const ProcessGroup&) = delete;
+    ProcessGroup& operator=(const ProcessGroup&) = delete;
+
+    int rank() const {return rank_;};
+    int world_size() const {return world_size_;};
+
+    // exits instead of waiting forever when another rank of the group is gone
+    void barrier();
+    // buffers are (data, count) pairs treated as one flat array
+    void all_reduce_mean(const vector<pair<float*, size_t>>& buffers);
+    void broadcast(const vector<pair<float*, size_t>>& buffers, int root = 0);
+
+private:
+    ProcessGroup(int rank, int world_size, size_t slot_floats, void* shared, size_t shared_bytes);
+    float* slot(int rank) const;
+    void check_peers();
+    static void pin_to_node(int rank);
+
+    int rank_;
+    int world_size_;
+    size_t slot_floats_;
+    void* shared_;
+    size_t shared_bytes_;
+    float* result_;
+    vector<pid_t> children_;
+    pid_t launcher_;
+};
+
+} // namespace micronet
+
+#endif // PROCESSGROUP_H
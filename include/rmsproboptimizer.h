@@ -10,7 +10,12 @@ class RMSProbOptimizer: public Optimizer{
 public:
     RMSProbOptimizer() = default;
     RMSProbOptimizer(float learning_rate, vector<float> decay_locs, float decay_rate = 0.5);
-    virtual void optimize(const shared_ptr<Chunk>& param, int iter);
+    virtual void prepare(const shared_ptr<Chunk>& param);
+protected:
+    virtual StepHps resolve(int iter);
+    virtual StepBuffers buffers(const shared_ptr<Chunk>& param);
+    virtual void update(const StepHps& hps, const StepBuffers& buffers, int begin, int end);
+
 private:
     map<Chunk*, Chunk> accumulate_squared_gradient_;
 };
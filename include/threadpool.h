@@ -0,0 +1,142 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+#include <sched.h>
+#include <vector>
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+using namespace std;
+
+namespace micronet {
+
+// Elementwise loops are split no finer than this many elements.
+const int ELEMENTWISE_GRAIN = 1 << 14;
+
+// Grain for loops whose items each cost about item_size elements of work,
+// e.g. one (sample, channel) plane of a feature map.
+inline int plane_grain(int item_size) {
+    return max(1, ELEMENTWISE_GRAIN / max(1, item_size));
+}
+
+class ThreadPool;
+
+// How many threads the code running on this thread may use. parallel_for
+// runs its chunks on at most that many threads and splits the context
+// between them, so a kernel called from inside a parallel region runs
+// serially or on a sub-team instead of fanning out again. Without a context
+// the whole pool is available. A context with cores also confines its thread
+// and the runners of its parallel_for calls to those cores, e.g. a pipeline
+// stage whose weights stay in the caches of its own cores. Without cores a
+// context keeps the cores of the one it nests in.
+class ExecContext {
+public:
+    explicit ExecContext(int num_threads, const vector<int>& cores = {});
+    ~ExecContext();
+    ExecContext(const ExecContext&) = delete;
+    ExecContext& operator=(const ExecContext&) = delete;
+
+    int num_threads() const {return num_threads_;};
+    static int current_threads();
+    static vector<int> current_cores();
+
+private:
+    int num_threads_;
+    vector<int> cores_;
+    bool pinned_;
+    cpu_set_t previous_cpus_;
+    const ExecContext* previous_;
+};
+
+// Layers parallelize over samples when there is a sample per thread and
+// otherwise run samples in turn, leaving the threads to the kernels.
+inline bool batch_parallel(int num) {
+    return num >= ExecContext::current_threads();
+}
+
+// Tasks submitted together and waited on together. wait() runs the group's
+// own queued tasks while it is unfinished and sleeps when there are none, so
+// groups can nest inside pool tasks without a waiter picking up unrelated
+// work, e.g. a task that needs a lock the waiter holds.
+class TaskGroup {
+public:
+    explicit TaskGroup(ThreadPool& pool): pool_(pool), pending_(0), queued_(0) {};
+    ~TaskGroup() {wait();};
+    void run(function<void()> task);
+    void wait();
+
+private:
+    ThreadPool& pool_;
+    atomic<int> pending_;
+    atomic<int> queued_;
+    friend class ThreadPool;
+};
+
+// Work stealing pool shared by every net in the process. Each worker owns a
+// deque: it pops its own tasks LIFO and steals from the others FIFO. The
+// calling thread counts as one of num_threads and helps while it waits.
+class ThreadPool {
+public:
+    static ThreadPool& instance();
+    ~ThreadPool();
+
+    void set_num_threads(int num_threads);
+    int num_threads() const {return int(workers_.size()) + 1;};
+    // pin worker i to cores[i % cores.size()], all cores taken round robin
+    // over the NUMA nodes when cores is empty
+    void set_affinity(const vector<int>& cores = {});
+
+    void parallel_for(int begin, int end, const function<void(int, int)>& fn, int grain = 1);
+
+private:
+    struct Task {
+        function<void()> fn;
+        TaskGroup* group;
+    };
+    struct WorkQueue {
+        mutex lock;
+        deque<Task> tasks;
+    };
+
+    explicit ThreadPool(int num_threads);
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void start(int num_threads);
+    void stop();
+    void submit(Task task);
+    // any task when group is null, otherwise only tasks of that group
+    bool run_one(int self, TaskGroup* group = nullptr);
+    bool take_task(WorkQueue& queue, bool newest, TaskGroup* group, Task& task);
+    void worker_loop(int index);
+    void pin_worker(int index);
+
+    vector<unique_ptr<WorkQueue>> queues_;
+    vector<thread> workers_;
+    vector<int> cores_;
+    atomic<int> queued_;
+    atomic<unsigned> next_queue_;
+    bool stop_;
+    mutex sleep_lock_;
+    condition_variable wake_;
+
+    friend class TaskGroup;
+};
+
+inline void parallel_for(int begin, int end, const function<void(int, int)>& fn, int grain = 1) {
+    ThreadPool::instance().parallel_for(begin, end, fn, grain);
+}
+
+void set_num_threads(int num_threads);
+int get_num_threads();
+// whether the pool threads exist, they do not survive a fork
+bool thread_pool_started();
+
+} // namespace micronet
+
+#endif // THREADPOOL_H
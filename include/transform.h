@@ -0,0 +1,91 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+#include <vector>
+#include <memory>
+#include <string>
+
+using namespace std;
+
+namespace micronet {
+
+// A per-sample preprocessing step run by DataProvider while it loads a batch.
+// Shapes are {channels, height, width}. Random transforms draw from the seed
+// they are given, so stages sharing a source and a transform prefix see the
+// same crop/flip for a sample.
+class Transform {
+public:
+    Transform(const string& transform_type): transform_type_(transform_type) {};
+    virtual ~Transform(){};
+    virtual vector<int> shape_inference(const vector<int>& in_shape) = 0;
+    virtual void apply(const float* in, const vector<int>& in_shape, float* out,
+                       bool augment, unsigned seed) = 0;
+    const string& transform_type() const {return transform_type_;};
+
+protected:
+    string transform_type_;
+};
+
+using transform_ptr = shared_ptr<Transform>;
+
+// Zero pads by pad pixels and takes a random crop_h x crop_w window,
+// center crop when not augmenting.
+class RandomCrop: public Transform {
+public:
+    RandomCrop(int crop_h, int crop_w, int pad = 0);
+    virtual vector<int> shape_inference(const vector<int>& in_shape) override;
+    virtual void apply(const float* in, const vector<int>& in_shape, float* out,
+                       bool augment, unsigned seed) override;
+
+private:
+    int crop_h_, crop_w_, pad_;
+};
+
+// Horizontal flip with probability prob, identity when not augmenting.
+class RandomFlip: public Transform {
+public:
+    RandomFlip(float prob = 0.5);
+    virtual vector<int> shape_inference(const vector<int>& in_shape) override;
+    virtual void apply(const float* in, const vector<int>& in_shape, float* out,
+                       bool augment, unsigned seed) override;
+
+private:
+    float prob_;
+};
+
+// Bilinear resize by h_rate, w_rate.
+class Resize: public Transform {
+public:
+    Resize(float h_rate, float w_rate);
+    virtual vector<int> shape_inference(const vector<int>& in_shape) override;
+    virtual void apply(const float* in, const vector<int>& in_shape, float* out,
+                       bool augment, unsigned seed) override;
+
+private:
+    float h_rate_, w_rate_;
+};
+
+// L component of HSL, (max + min) / 2 over the RGB channels.
+class RGBToL: public Transform {
+public:
+    RGBToL(): Transform("RGBToL") {};
+    virtual vector<int> shape_inference(const vector<int>& in_shape) override;
+    virtual void apply(const float* in, const vector<int>& in_shape, float* out,
+                       bool augment, unsigned seed) override;
+};
+
+// Bilinear down sampling by factor followed by up sampling back, the
+// super-resolution input that cal_low_imgs used to precompute.
+class LowResolution: public Transform {
+public:
+    LowResolution(float factor = 0.5);
+    virtual vector<int> shape_inference(const vector<int>& in_shape) override;
+    virtual void apply(const float* in, const vector<int>& in_shape, float* out,
+                       bool augment, unsigned seed) override;
+
+private:
+    float factor_;
+};
+
+} // namespace micronet
+
+#endif // TRANSFORM_H
@@ -12,6 +12,8 @@
 #include "nlohmann/json.hpp"
 #include "net.h"
 #include "math_func.h"
+#include "binarymodel.h"
+#include "jsonmodel.h"
 
 using namespace std;
 using json = nlohmann::json;
@@ -32,6 +34,7 @@ void img2col(const float* data_im, int channels,  int height,  int width, int ks
 void col2img(const float* data_col, int channels, int height, int width, int ksize_h,
              int ksize_w, int pad_h, int pad_w, int stride_h, int stride_w, float* data_im);
 
+int next_seed();
 void normal_random_init(int n, float* x, float mean, float seddev, int seed=-1);
 void uniform_random_init(int n, float* x, float lower, float upper, int seed=-1);
 void constant_init(int n, float* x, float val);
@@ -87,8 +90,8 @@ struct NormalGenerator {
     }
 };
 
-void to_json(json& j_net, Net* net);
-void from_json(const json& j_net, Net* net);
+void to_json(json& j_net, Net* net, bool with_data = true);
+void from_json(const json& j_net, Net* net, const BlobSource* blobs = nullptr);
 
 } // namespace micronet
 
@@ -2,6 +2,7 @@
 #include <cmath>
 #include "activation.h"
 #include "util.h"
+#include "threadpool.h"
 
 namespace micronet {
 
@@ -43,67 +44,76 @@ void Activation::forward(bool is_train) {
     float* output_data = chunks_out_[0]->data();
 
     if (str_hps_["activation"] == "relu") {
-        #pragma omp parallel for
-        for (int i = 0; i < chunks_in_[0]->count(); ++i) {
-            output_data[i] = std::max(0.0f, input_data[i]);
-        }
+        parallel_for(0, chunks_in_[0]->count(), [&](int begin, int end) {
+            for (int i = begin; i < end; ++i) {
+                output_data[i] = std::max(0.0f, input_data[i]);
+            }
+        }, ELEMENTWISE_GRAIN);
     } else if (str_hps_["activation"] == "leaky_relu") {
         float leaky_alpha = flt_hps_["leaky_alpha"];
-        #pragma omp parallel for
-        for (int i = 0; i < chunks_in_[0]->count(); ++i) {
-            output_data[i] = std::max(leaky_alpha*input_data[i], input_data[i]);
-        }
+        parallel_for(0, chunks_in_[0]->count(), [&](int begin, int end) {
+            for (int i = begin; i < end; ++i) {
+                output_data[i] = std::max(leaky_alpha*input_data[i], input_data[i]);
+            }
+        }, ELEMENTWISE_GRAIN);
     } else if (str_hps_["activation"] == "relu6") {
-        #pragma omp parallel for
-        for (int i = 0; i < chunks_in_[0]->count(); ++i) {
-            output_data[i] = std::min(std::max(0.0f, input_data[i]), 6.0f);
-        }
+        parallel_for(0, chunks_in_[0]->count(), [&](int begin, int end) {
+            for (int i = begin; i < end; ++i) {
+                output_data[i] = std::min(std::max(0.0f, input_data[i]), 6.0f);
+            }
+        }, ELEMENTWISE_GRAIN);
     } else if (str_hps_["activation"] == "sigmoid") {
-        #pragma omp parallel for
-        for (int i = 0; i < chunks_in_[0]->count(); ++i) {
-            output_data[i] = 1 / (1 + std::exp(-input_data[i]));
-        }
+        parallel_for(0, chunks_in_[0]->count(), [&](int begin, int end) {
+            for (int i = begin; i < end; ++i) {
+                output_data[i] = 1 / (1 + std::exp(-input_data[i]));
+            }
+        }, ELEMENTWISE_GRAIN);
     } else if (str_hps_["activation"] == "tanh") {
-        #pragma omp parallel for
-        for (int i = 0; i < chunks_in_[0]->count(); ++i) {
-            float pos_exp = std::exp(input_data[i]);
-            float neg_exp = std::exp(-input_data[i]);
-            output_data[i] = (pos_exp - neg_exp) / (pos_exp + neg_exp);
-        }
+        parallel_for(0, chunks_in_[0]->count(), [&](int begin, int end) {
+            for (int i = begin; i < end; ++i) {
+                float pos_exp = std::exp(input_data[i]);
+                float neg_exp = std::exp(-input_data[i]);
+                output_data[i] = (pos_exp - neg_exp) / (pos_exp + neg_exp);
+            }
+        }, ELEMENTWISE_GRAIN);
     } else if (str_hps_["activation"] == "elu") {
-        #pragma omp parallel for
-        for (int i = 0; i < chunks_in_[0]->count(); ++i) {
-            output_data[i] = input_data[i] > 0? input_data[i]: (std::exp(input_data[i]) - 1);
-        }
+        parallel_for(0, chunks_in_[0]->count(), [&](int begin, int end) {
+            for (int i = begin; i < end; ++i) {
+                output_data[i] = input_data[i] > 0? input_data[i]: (std::exp(input_data[i]) - 1);
+            }
+        }, ELEMENTWISE_GRAIN);
     } else if (str_hps_["activation"] == "selu") {
         float selu_lambda = flt_hps_["selu_lambda"];
         float selu_alpha = flt_hps_["selu_alpha"];
-        #pragma omp parallel for
-        for (int i = 0; i < chunks_in_[0]->count(); ++i) {
-            output_data[i] = selu_lambda * (input_data[i] > 0? input_data[i]: selu_alpha* (std::exp(input_data[i]) - 1));
-        }
+        parallel_for(0, chunks_in_[0]->count(), [&](int begin, int end) {
+            for (int i = begin; i < end; ++i) {
+                output_data[i] = selu_lambda * (input_data[i] > 0? input_data[i]: selu_alpha* (std::exp(input_data[i]) - 1));
+            }
+        }, ELEMENTWISE_GRAIN);
     } else if (str_hps_["activation"] == "prelu") {
         const float* alpha_data = params_[0]->const_data();
         chunk_ptr in_chunk = chunks_in_[0];
         chunk_ptr out_chunk = chunks_out_[0];
-        #pragma omp parallel for
-        for (int n = 0; n < in_chunk->num(); ++n) {
-            for (int c = 0; c < in_chunk->channels(); ++c) {
-                const int aindex = params_[0]->offset(0, c, 0, 0);
-                float alpha = alpha_data[aindex];
-                for (int h = 0; h < in_chunk->height(); ++h) {
-                    for (int w = 0; w < in_chunk->width(); ++w) {
-                        const int oindex = out_chunk->offset(n, c, h, w);
-                        output_data[oindex] = input_data[oindex] > 0? input_data[oindex]: alpha * input_data[oindex];
+        parallel_for(0, in_chunk->num(), [&](int begin, int end) {
+            for (int n = begin; n < end; ++n) {
+                for (int c = 0; c < in_chunk->channels(); ++c) {
+                    const int aindex = params_[0]->offset(0, c, 0, 0);
+                    float alpha = alpha_data[aindex];
+                    for (int h = 0; h < in_chunk->height(); ++h) {
+                        for (int w = 0; w < in_chunk->width(); ++w) {
+                            const int oindex = out_chunk->offset(n, c, h, w);
+                            output_data[oindex] = input_data[oindex] > 0? input_data[oindex]: alpha * input_data[oindex];
+                        }
                     }
                 }
             }
-        }
+        });
     } else if (str_hps_["activation"] == "sin") {
-        #pragma omp parallel for
-        for (int i = 0; i < chunks_in_[0]->count(); ++i) {
-            output_data[i] = std::sin(input_data[i]);
-        }
+        parallel_for(0, chunks_in_[0]->count(), [&](int begin, int end) {
+            for (int i = begin; i < end; ++i) {
+                output_data[i] = std::sin(input_data[i]);
+            }
+        }, ELEMENTWISE_GRAIN);
     }
     gradient_reset();
     //cout << "activation forward" << endl;
@@ -116,43 +126,50 @@ void Activation::backward() {
     float* input_diff = chunks_in_[0]->diff();
 
     if (str_hps_["activation"] == "relu") {
-        #pragma omp parallel for
-        for (int i = 0; i < chunks_in_[0]->count(); ++i) {
-            input_diff[i] += (input_data[i] > 0) * output_diff[i];
-        }
+        parallel_for(0, chunks_in_[0]->count(), [&](int begin, int end) {
+            for (int i = begin; i < end; ++i) {
+                input_diff[i] += (input_data[i] > 0) * output_diff[i];
+            }
+        }, ELEMENTWISE_GRAIN);
     } else if (str_hps_["activation"] == "leaky_relu") {
         float leaky_alpha = flt_hps_["leaky_alpha"];
-        #pragma omp parallel for
-        for (int i = 0; i < chunks_in_[0]->count(); ++i) {
-            input_diff[i] += input_data[i] > 0 ? output_diff[i]: leaky_alpha * output_diff[i];
-        }
+        parallel_for(0, chunks_in_[0]->count(), [&](int begin, int end) {
+            for (int i = begin; i < end; ++i) {
+                input_diff[i] += input_data[i] > 0 ? output_diff[i]: leaky_alpha * output_diff[i];
+            }
+        }, ELEMENTWISE_GRAIN);
     } else if (str_hps_["activation"] == "relu6") {
-        #pragma omp parallel for
-        for (int i = 0; i < chunks_in_[0]->count(); ++i) {
-            input_diff[i] += (input_data[i] > 0 && input_data[i] < 6) * output_diff[i];
-        }
+        parallel_for(0, chunks_in_[0]->count(), [&](int begin, int end) {
+            for (int i = begin; i < end; ++i) {
+                input_diff[i] += (input_data[i] > 0 && input_data[i] < 6) * output_diff[i];
+            }
+        }, ELEMENTWISE_GRAIN);
     } else if (str_hps_["activation"] == "sigmoid") {
-        #pragma omp parallel for
-        for (int i = 0; i < chunks_in_[0]->count(); ++i) {
-            input_diff[i] += output_data[i] * (1-output_data[i]) * output_diff[i];
-        }
+        parallel_for(0, chunks_in_[0]->count(), [&](int begin, int end) {
+            for (int i = begin; i < end; ++i) {
+                input_diff[i] += output_data[i] * (1-output_data[i]) * output_diff[i];
+            }
+        }, ELEMENTWISE_GRAIN);
     } else if (str_hps_["activation"] == "tanh") {
-        #pragma omp parallel for
-        for (int i = 0; i < chunks_in_[0]->count(); ++i) {
-            input_diff[i] += (1 - std::pow(output_data[i], 2)) * output_diff[i];
-        }
+        parallel_for(0, chunks_in_[0]->count(), [&](int begin, int end) {
+            for (int i = begin; i < end; ++i) {
+                input_diff[i] += (1 - std::pow(output_data[i], 2)) * output_diff[i];
+            }
+        }, ELEMENTWISE_GRAIN);
     } else if (str_hps_["activation"] == "elu") {
-        #pragma omp parallel for
-        for (int i = 0; i < chunks_in_[0]->count(); ++i) {
-            input_diff[i] += input_data[i] > 0 ? output_diff[i]: std::exp(input_data[i]) * output_diff[i];
-        }
+        parallel_for(0, chunks_in_[0]->count(), [&](int begin, int end) {
+            for (int i = begin; i < end; ++i) {
+                input_diff[i] += input_data[i] > 0 ? output_diff[i]: std::exp(input_data[i]) * output_diff[i];
+            }
+        }, ELEMENTWISE_GRAIN);
     } else if (str_hps_["activation"] == "selu") {
         float selu_lambda = flt_hps_["selu_lambda"];
         float selu_alpha = flt_hps_["selu_alpha"];
-        #pragma omp parallel for
-        for (int i = 0; i < chunks_in_[0]->count(); ++i) {
-            input_diff[i] += selu_lambda * (input_data[i] > 0 ? output_diff[i]: selu_alpha * std::exp(input_data[i])) * output_diff[i];
-        }
+        parallel_for(0, chunks_in_[0]->count(), [&](int begin, int end) {
+            for (int i = begin; i < end; ++i) {
+                input_diff[i] += selu_lambda * (input_data[i] > 0 ? output_diff[i]: selu_alpha * std::exp(input_data[i])) * output_diff[i];
+            }
+        }, ELEMENTWISE_GRAIN);
     } else if (str_hps_["activation"] == "prelu") {
         const float* alpha_data = params_[0]->const_data();
         float* alpha_diff = params_[0]->diff();
@@ -173,10 +190,11 @@ void Activation::backward() {
             }
         }
     } else if (str_hps_["activation"] == "sin") {
-        #pragma omp parallel for
-        for (int i = 0; i < chunks_in_[0]->count(); ++i) {
-            input_diff[i] += std::cos(input_data[i]) * output_diff[i];
-        }
+        parallel_for(0, chunks_in_[0]->count(), [&](int begin, int end) {
+            for (int i = begin; i < end; ++i) {
+                input_diff[i] += std::cos(input_data[i]) * output_diff[i];
+            }
+        }, ELEMENTWISE_GRAIN);
     }
 }
 
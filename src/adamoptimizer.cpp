@@ -4,12 +4,78 @@
  * @data 2018/6/25
  **/
 #include <thread>
-#include <omp.h>
+#include <string.h>
+#include <stdint.h>
 #include "adamoptimizer.h"
+#include "threadpool.h"
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif // __SSE__
 
 namespace micronet {
 
-AdamOptimizer::AdamOptimizer(float learning_rate, vector<float> decay_locs, float decay_rate_1, float decay_rate_2):
+// Compact moments round stochastically: an EMA step of 1 - decay_rate_2 is
+// far below a bf16 or int8 step and rounding to nearest would drop it every
+// time. The noise hashes the element, the iteration and the moment, so
+// results do not depend on the thread count.
+inline uint32_t rounding_noise(uint32_t index, uint32_t iter, uint32_t moment) {
+    uint32_t hash = index * 0x9e3779b9u ^ (iter + moment * 0x7f4a7c15u) * 0x85ebca6bu;
+    hash ^= hash >> 16;
+    hash *= 0x7feb352du;
+    hash ^= hash >> 15;
+    hash *= 0x846ca68bu;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+// bf16 keeps the upper half of a float, noise is the rounding threshold
+inline uint16_t float_to_bf16(float value, uint32_t noise) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    bits += noise & 0xffff;
+    return uint16_t(bits >> 16);
+}
+
+inline float bf16_to_float(uint16_t half) {
+    uint32_t bits = uint32_t(half) << 16;
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// int8 blocks store levels * sqrt(|x| / max|x|), rounded stochastically, and
+// the block max as scale, the square root companding keeps the relative
+// precision of values far below the largest of their block
+template <typename T>
+void quantize_block(const float* values, int n, int levels, uint32_t index, uint32_t iter, uint32_t moment,
+                    T* quantized, float& scale) {
+    float max_abs = 0;
+    for (int i = 0; i < n; ++i) {
+        max_abs = max(max_abs, std::fabs(values[i]));
+    }
+    scale = max_abs;
+    for (int i = 0; i < n; ++i) {
+        float level = 0;
+        if (max_abs > 0) {
+            float level_value = levels * std::sqrt(std::fabs(values[i]) / max_abs);
+            float noise = (rounding_noise(index + i, iter, moment) >> 8) * (1.0f / (1 << 24));
+            level = min(float(levels), std::floor(level_value + noise));
+        }
+        quantized[i] = T(values[i] < 0? -level: level);
+    }
+}
+
+template <typename T>
+void dequantize_block(const T* quantized, int n, int levels, float scale, float* values) {
+    for (int i = 0; i < n; ++i) {
+        float level = float(quantized[i]) / levels;
+        values[i] = (level < 0? -scale: scale) * level * level;
+    }
+}
+
+AdamOptimizer::AdamOptimizer(float learning_rate, vector<float> decay_locs, float decay_rate_1, float decay_rate_2,
+                             const string& state_precision):
      Optimizer("Adam", decay_locs) {
     flt_hps_["learning_rate"] = learning_rate;
     flt_hps_["decay_rate_1"] = decay_rate_1;
@@ -17,55 +83,201 @@ AdamOptimizer::AdamOptimizer(float learning_rate, vector<float> decay_locs, floa
     flt_hps_["decay_rate_1_pow"] = 1;
     flt_hps_["decay_rate_2_pow"] = 1;
     int_hps_["iter"] = 0;
+    str_hps_["state_precision"] = state_precision;
+    this->state_precision();
+}
+
+string AdamOptimizer::state_precision() const {
+    auto precision = str_hps_.find("state_precision");
+    if (precision == str_hps_.end() || precision->second == "fp32") {
+        return "fp32";
+    }
+    if (precision->second != "bf16" && precision->second != "int8") {
+        cout << "adam state precision " << precision->second << " is not supported, use fp32, bf16 or int8!" << endl;
+        exit(1);
+    }
+    return precision->second;
 }
 
-void AdamOptimizer::optimize(const shared_ptr<Chunk>& param, int iter) {
-    float decay_loc = (float)iter / total_iters_;
-    int decay_index = find_if(decay_locs_.begin(), decay_locs_.end(),
-                              [&decay_loc](float loc) {return loc > decay_loc;}) - decay_locs_.begin();
-    float learning_rate = flt_hps_["learning_rate"] * pow(0.1, decay_index);
+AdamOptimizer::CompactMoments AdamOptimizer::new_compact_moments(int count) const {
+    bool int8 = state_precision() == "int8";
+    int blocks = (count + STATE_BLOCK - 1) / STATE_BLOCK;
+    size_t values = size_t(blocks) * STATE_BLOCK;
+    size_t scale_floats = int8? 2 * blocks: 0;
+    CompactMoments moments;
+    moments.value_bytes = int8? 1: 2;
+    moments.offset = 0;
+    moments.holder = make_shared<vector<float>>(scale_floats + (2 * values * moments.value_bytes + 3) / 4, 0.0f);
+    float* base = moments.holder->data();
+    moments.scales[0] = int8? base: nullptr;
+    moments.scales[1] = int8? base + blocks: nullptr;
+    moments.values[0] = reinterpret_cast<char*>(base + scale_floats);
+    moments.values[1] = moments.values[0] + values * moments.value_bytes;
+    return moments;
+}
 
+// same as Optimizer::state, packed params view the arena's moments
+AdamOptimizer::CompactMoments& AdamOptimizer::compact_state(const shared_ptr<Chunk>& param) {
+    Chunk* key = state_key(param);
+    auto found = compact_moments_.find(key);
+    if (found != compact_moments_.end()) {
+        return found->second;
+    }
+    auto view = state_views_.find(key);
+    if (view == state_views_.end()) {
+        return compact_moments_[key] = new_compact_moments(param->count());
+    }
+    Chunk* arena = view->second.first;
+    auto arena_state = compact_moments_.find(arena);
+    if (arena_state == compact_moments_.end()) {
+        arena_state = compact_moments_.insert({arena, new_compact_moments(arena->count())}).first;
+    }
+    int offset = view->second.second;
+    CompactMoments moments = arena_state->second;
+    moments.offset = offset;
+    for (int k = 0; k < 2; ++k) {
+        moments.values[k] += size_t(offset) * moments.value_bytes;
+        if (moments.scales[k] != nullptr) {
+            moments.scales[k] += offset / STATE_BLOCK;
+        }
+    }
+    return compact_moments_[key] = moments;
+}
+
+void AdamOptimizer::prepare(const shared_ptr<Chunk>& param) {
+    if (state_precision() != "fp32") {
+        compact_state(param);
+        return;
+    }
+    state(first_moment_estimate_, param);
+    state(second_moment_estimate_, param);
+}
+
+void AdamOptimizer::begin_iter(int iter) {
     if (iter != int_hps_["iter"]) {
-        //cout << decay_rate_1_pow_ << endl;
-        //exit(0);
         int_hps_["iter"] = iter;
         flt_hps_["decay_rate_1_pow"] *= flt_hps_["decay_rate_1"];
         flt_hps_["decay_rate_2_pow"] *= flt_hps_["decay_rate_2"];
-        /*if (iter %100 == 0) {
-            cout << "iter:" << iter << endl;
-            cout << decay_rate_1_ << " " << decay_rate_2_ << endl;
-            cout << "decay1:" << decay_rate_1_pow_ << endl;
-            cout << "decay2:" << decay_rate_2_pow_ << endl;
-        }*/
     }
+}
 
-    if (first_moment_estimate_.find(param.get()) == first_moment_estimate_.end()) {
-        first_moment_estimate_[param.get()] = Chunk(param->shape());
-    }
-    if (second_moment_estimate_.find(param.get()) == second_moment_estimate_.end()) {
-        second_moment_estimate_[param.get()] = Chunk(param->shape());
+AdamOptimizer::StepHps AdamOptimizer::resolve(int iter) {
+    begin_iter(iter);
+    float learning_rate = decayed_learning_rate(iter);
+    float decay_rate_1_pow = flt_hps_.at("decay_rate_1_pow");
+    float decay_rate_2_pow = flt_hps_.at("decay_rate_2_pow");
+    float alpha_t = learning_rate * std::sqrt(1-decay_rate_2_pow) / (1-decay_rate_1_pow);
+    return {alpha_t, flt_hps_.at("decay_rate_1"), flt_hps_.at("decay_rate_2")};
+}
+
+AdamOptimizer::StepBuffers AdamOptimizer::buffers(const shared_ptr<Chunk>& param) {
+    if (state_precision() != "fp32") {
+        const CompactMoments& moments = compact_state(param);
+        StepBuffers compact = {param->data(), param->const_diff(), {nullptr, nullptr},
+                               {moments.values[0], moments.values[1]}, {moments.scales[0], moments.scales[1]}};
+        compact.state_offset = moments.offset;
+        return compact;
     }
-    const float* diff = param->const_diff();
-    float* data = param->data();
-    float* first_moment_est = first_moment_estimate_[param.get()].data();
-    float* second_moment_est = second_moment_estimate_[param.get()].data();
+    return {param->data(), param->const_diff(),
+            {state(first_moment_estimate_, param).data(), state(second_moment_estimate_, param).data()}};
+}
 
-    float decay_rate_1 = flt_hps_["decay_rate_1"];
-    float decay_rate_2 = flt_hps_["decay_rate_2"];
-    float decay_rate_1_pow = flt_hps_["decay_rate_1_pow"];
-    float decay_rate_2_pow = flt_hps_["decay_rate_2_pow"];
+void AdamOptimizer::update(const StepHps& hps, const StepBuffers& buffers, int begin, int end) {
+    if (buffers.packed_state[0] != nullptr) {
+        compact_update(hps, buffers, begin, end);
+        return;
+    }
+    float alpha_t = hps.learning_rate;
+    float decay_rate_1 = hps.rate_1;
+    float decay_rate_2 = hps.rate_2;
+    const float* diff = buffers.diff;
+    float* data = buffers.data;
+    float* first_moment_est = buffers.state[0];
+    float* second_moment_est = buffers.state[1];
 
-    #pragma omp parallel for
-    for (int i = 0; i < param->count(); i++) {
+    int i = begin;
+#ifdef __SSE__
+    __m128 v_decay_rate_1 = _mm_set1_ps(decay_rate_1);
+    __m128 v_decay_rate_2 = _mm_set1_ps(decay_rate_2);
+    __m128 v_keep_rate_1 = _mm_set1_ps(1 - decay_rate_1);
+    __m128 v_keep_rate_2 = _mm_set1_ps(1 - decay_rate_2);
+    __m128 v_alpha_t = _mm_set1_ps(-alpha_t);
+    __m128 v_epsilon = _mm_set1_ps(1e-8f);
+    for (; i + 4 <= end; i += 4) {
+        __m128 g = _mm_loadu_ps(diff + i);
+        __m128 m = _mm_add_ps(_mm_mul_ps(v_decay_rate_1, _mm_loadu_ps(first_moment_est + i)),
+                              _mm_mul_ps(v_keep_rate_1, g));
+        __m128 v = _mm_add_ps(_mm_mul_ps(v_decay_rate_2, _mm_loadu_ps(second_moment_est + i)),
+                              _mm_mul_ps(_mm_mul_ps(v_keep_rate_2, g), g));
+        _mm_storeu_ps(first_moment_est + i, m);
+        _mm_storeu_ps(second_moment_est + i, v);
+        __m128 update = _mm_div_ps(_mm_mul_ps(v_alpha_t, m), _mm_add_ps(_mm_sqrt_ps(v), v_epsilon));
+        _mm_storeu_ps(data + i, _mm_add_ps(_mm_loadu_ps(data + i), update));
+    }
+#endif // __SSE__
+    for (; i < end; ++i) {
         first_moment_est[i] = decay_rate_1 * first_moment_est[i] + (1 - decay_rate_1) * diff[i];
         second_moment_est[i] = decay_rate_2 * second_moment_est[i] + (1 - decay_rate_2) * diff[i] * diff[i];
-        //float corrected_first_moment = first_moment_est[i] / (1 - decay_rate_1_pow_);
-        //float corrected_second_moment = second_moment_est[i] / (1 - decay_rate_2_pow_);
-        //float update = (-learning_rate) * corrected_first_moment / (std::sqrt(corrected_second_moment) + 1e-8F);
-        float alpha_t = learning_rate * std::sqrt(1-decay_rate_2_pow) / (1-decay_rate_1_pow);
         float update = (-alpha_t) * first_moment_est[i] / (std::sqrt(second_moment_est[i])+1e-8f);
         data[i] += update;
     }
 }
 
+// Dequantizes a block of moments, runs the update on it and quantizes it back.
+void AdamOptimizer::compact_update(const StepHps& hps, const StepBuffers& buffers, int begin, int end) {
+    float alpha_t = hps.learning_rate;
+    float decay_rate_1 = hps.rate_1;
+    float decay_rate_2 = hps.rate_2;
+    const float* diff = buffers.diff;
+    float* data = buffers.data;
+    bool int8 = buffers.state_scales[0] != nullptr;
+    uint32_t iter = int_hps_.at("iter");
+    uint32_t offset = buffers.state_offset;
+
+    float first_moment_est[STATE_BLOCK], second_moment_sqrt[STATE_BLOCK];
+    for (int block = begin; block < end; block += STATE_BLOCK) {
+        int n = min(STATE_BLOCK, end - block);
+        int b = block / STATE_BLOCK;
+        // int8 can not tell a second moment apart from 0 below its first level,
+        // a per-block epsilon of that size bounds the update of such weights
+        float epsilon = 1e-8f;
+        if (int8) {
+            epsilon += buffers.state_scales[1][b] / (255 * 255);
+            dequantize_block(static_cast<int8_t*>(buffers.packed_state[0]) + block, n, 127,
+                             buffers.state_scales[0][b], first_moment_est);
+            dequantize_block(static_cast<uint8_t*>(buffers.packed_state[1]) + block, n, 255,
+                             buffers.state_scales[1][b], second_moment_sqrt);
+        } else {
+            const uint16_t* first = static_cast<uint16_t*>(buffers.packed_state[0]) + block;
+            const uint16_t* second = static_cast<uint16_t*>(buffers.packed_state[1]) + block;
+            for (int i = 0; i < n; ++i) {
+                first_moment_est[i] = bf16_to_float(first[i]);
+                second_moment_sqrt[i] = bf16_to_float(second[i]);
+            }
+        }
+
+        for (int i = 0; i < n; ++i) {
+            float g = diff[block + i];
+            first_moment_est[i] = decay_rate_1 * first_moment_est[i] + (1 - decay_rate_1) * g;
+            float second_moment_est = decay_rate_2 * second_moment_sqrt[i] * second_moment_sqrt[i] + (1 - decay_rate_2) * g * g;
+            second_moment_sqrt[i] = std::sqrt(second_moment_est);
+            data[block + i] += (-alpha_t) * first_moment_est[i] / (second_moment_sqrt[i]+epsilon);
+        }
+
+        if (int8) {
+            quantize_block(first_moment_est, n, 127, offset + block, iter, 0,
+                           static_cast<int8_t*>(buffers.packed_state[0]) + block, buffers.state_scales[0][b]);
+            quantize_block(second_moment_sqrt, n, 255, offset + block, iter, 1,
+                           static_cast<uint8_t*>(buffers.packed_state[1]) + block, buffers.state_scales[1][b]);
+        } else {
+            uint16_t* first = static_cast<uint16_t*>(buffers.packed_state[0]) + block;
+            uint16_t* second = static_cast<uint16_t*>(buffers.packed_state[1]) + block;
+            for (int i = 0; i < n; ++i) {
+                first[i] = float_to_bf16(first_moment_est[i], rounding_noise(offset + block + i, iter, 0));
+                second[i] = float_to_bf16(second_moment_sqrt[i], rounding_noise(offset + block + i, iter, 1));
+            }
+        }
+    }
+}
+
 } // namespace micronet
@@ -0,0 +1,157 @@
+/**
+ * @file allocator.cpp
+ * @auther yefajie
+ * @data 2026/10/19
+ **/
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <thread>
+
+#include "allocator.h"
+
+#ifndef MPOL_INTERLEAVE
+#define MPOL_INTERLEAVE 3
+#endif
+
+namespace micronet {
+
+static atomic<int>& memory_policy() {
+    static atomic<int> policy([] {
+        const char* env = getenv("MICRONET_MEMORY_POLICY");
+        bool interleave = env != nullptr && strcmp(env, "interleave") == 0;
+        return int(interleave? MemoryPolicy::interleave: MemoryPolicy::first_touch);
+    }());
+    return policy;
+}
+
+static atomic<bool>& huge_pages() {
+    static atomic<bool> enable([] {
+        const char* env = getenv("MICRONET_HUGE_PAGES");
+        return env == nullptr || atoi(env) != 0;
+    }());
+    return enable;
+}
+
+void set_memory_policy(MemoryPolicy policy) {
+    memory_policy() = int(policy);
+}
+
+MemoryPolicy get_memory_policy() {
+    return MemoryPolicy(memory_policy().load());
+}
+
+void set_huge_pages(bool enable) {
+    huge_pages() = enable;
+}
+
+bool get_huge_pages() {
+    return huge_pages();
+}
+
+// "0-3,8-11" style lists from sysfs
+static vector<int> parse_cpu_list(const string& list) {
+    vector<int> ids;
+    stringstream ranges(list);
+    string range;
+    while (getline(ranges, range, ',')) {
+        if (range.empty() || range == "\n") {
+            continue;
+        }
+        size_t dash = range.find('-');
+        int first = stoi(range.substr(0, dash));
+        int last = dash == string::npos? first: stoi(range.substr(dash + 1));
+        for (int id = first; id <= last; ++id) {
+            ids.push_back(id);
+        }
+    }
+    return ids;
+}
+
+vector<vector<int>> numa_node_cores() {
+    static const vector<vector<int>> node_cores = [] {
+        vector<vector<int>> nodes;
+        ifstream online("/sys/devices/system/node/online");
+        string list;
+        if (online && getline(online, list)) {
+            for (int node: parse_cpu_list(list)) {
+                ifstream cpus("/sys/devices/system/node/node" + to_string(node) + "/cpulist");
+                string cpu_list;
+                if (cpus && getline(cpus, cpu_list)) {
+                    vector<int> cores = parse_cpu_list(cpu_list);
+                    if (!cores.empty()) {
+                        nodes.push_back(cores);
+                    }
+                }
+            }
+        }
+        if (nodes.empty()) {
+            nodes.push_back({});
+            for (int c = 0; c < int(thread::hardware_concurrency()); ++c) {
+                nodes[0].push_back(c);
+            }
+        }
+        return nodes;
+    }();
+    return node_cores;
+}
+
+static void interleave_pages(void* buffer, size_t bytes) {
+    static const vector<int> nodes = [] {
+        vector<int> ids;
+        ifstream online("/sys/devices/system/node/online");
+        string list;
+        if (online && getline(online, list)) {
+            ids = parse_cpu_list(list);
+        }
+        return ids;
+    }();
+    if (nodes.size() < 2) {
+        return;
+    }
+    const int bits = 8 * sizeof(unsigned long);
+    vector<unsigned long> mask(nodes.back() / bits + 1, 0);
+    for (int node: nodes) {
+        mask[node / bits] |= 1UL << (node % bits);
+    }
+    // best effort, the default policy is still correct when this fails
+    syscall(SYS_mbind, buffer, bytes, MPOL_INTERLEAVE, mask.data(), mask.size() * bits + 1, 0);
+}
+
+float* allocate_floats(size_t count) {
+    size_t bytes = max(count, size_t(1)) * sizeof(float);
+    size_t alignment = 64;
+    bool large = bytes >= HUGE_PAGE_BYTES;
+    if (large) {
+        alignment = HUGE_PAGE_BYTES;
+        bytes = (bytes + HUGE_PAGE_BYTES - 1) / HUGE_PAGE_BYTES * HUGE_PAGE_BYTES;
+    }
+    void* buffer = nullptr;
+    if (posix_memalign(&buffer, alignment, bytes) != 0) {
+        cout << "allocate " << bytes << " bytes failed!" << endl;
+        exit(1);
+    }
+    if (large) {
+#ifdef MADV_HUGEPAGE
+        if (get_huge_pages()) {
+            madvise(buffer, bytes, MADV_HUGEPAGE);
+        }
+#endif // MADV_HUGEPAGE
+        if (get_memory_policy() == MemoryPolicy::interleave) {
+            interleave_pages(buffer, bytes);
+        }
+    }
+    return static_cast<float*>(buffer);
+}
+
+void free_floats(float* buffer) {
+    free(buffer);
+}
+
+} // namespace micronet
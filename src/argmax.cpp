@@ -5,7 +5,6 @@
  **/
 #include <utility>
 #include <algorithm>
-#include <omp.h>
 #include "argmax.h"
 
 namespace micronet {
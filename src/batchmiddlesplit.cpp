@@ -1,4 +1,3 @@
-#include <omp.h>
 #include <string.h>
 #include "batchmiddlesplit.h"
 #include "math_func.h"
@@ -1,8 +1,8 @@
 #include <cstring>
-#include "omp.h"
 #include "batchnormalization.h"
 #include "math_func.h"
 #include "util.h"
+#include "threadpool.h"
 
 namespace micronet {
 
@@ -62,34 +62,36 @@ void BatchNormalization::forward(bool is_train) {
 
     if (is_train) {
         const int m = in_chunk->count() / in_chunk->channels();
-        #pragma omp parallel for
-        for (int c = 0; c < in_chunk->channels(); ++c) {
-            const int mindex = mean->offset(0, c, 0, 0);
-            mean_data[mindex] = 0;
-            for (int n = 0; n < in_chunk->num(); ++n) {
-                for (int h = 0; h < in_chunk->height(); ++h) {
-                    for (int w = 0; w < in_chunk->width(); ++w) {
-                        const int iindex = in_chunk->offset(n, c, h, w);
-                        mean_data[mindex] += in_data[iindex];
+        parallel_for(0, in_chunk->channels(), [&](int begin, int end) {
+            for (int c = begin; c < end; ++c) {
+                const int mindex = mean->offset(0, c, 0, 0);
+                mean_data[mindex] = 0;
+                for (int n = 0; n < in_chunk->num(); ++n) {
+                    for (int h = 0; h < in_chunk->height(); ++h) {
+                        for (int w = 0; w < in_chunk->width(); ++w) {
+                            const int iindex = in_chunk->offset(n, c, h, w);
+                            mean_data[mindex] += in_data[iindex];
+                        }
                     }
                 }
+                mean_data[mindex] /= m;
             }
-            mean_data[mindex] /= m;
-        }
-        #pragma omp parallel for
-        for (int c = 0; c < in_chunk->channels(); ++c) {
-            const int vindex = var->offset(0, c, 0, 0);
-            var_data[vindex] = 0;
-            for (int n = 0; n < in_chunk->num(); ++n) {
-                for (int h = 0; h < in_chunk->height(); ++h) {
-                    for (int w = 0; w < in_chunk->width(); ++w) {
-                        const int iindex = in_chunk->offset(n, c, h, w);
-                        var_data[vindex] += std::pow(in_data[iindex] - mean_data[vindex], 2);
+        });
+        parallel_for(0, in_chunk->channels(), [&](int begin, int end) {
+            for (int c = begin; c < end; ++c) {
+                const int vindex = var->offset(0, c, 0, 0);
+                var_data[vindex] = 0;
+                for (int n = 0; n < in_chunk->num(); ++n) {
+                    for (int h = 0; h < in_chunk->height(); ++h) {
+                        for (int w = 0; w < in_chunk->width(); ++w) {
+                            const int iindex = in_chunk->offset(n, c, h, w);
+                            var_data[vindex] += std::pow(in_data[iindex] - mean_data[vindex], 2);
+                        }
                     }
                 }
+                var_data[vindex] /= m;
             }
-            var_data[vindex] /= m;
-        }
+        });
 
         if (int_hps_["iter"] == 0) {
             memcpy(avg_mean_data, mean_data, mean->count()*sizeof(float));
@@ -100,35 +102,37 @@ void BatchNormalization::forward(bool is_train) {
         }
         int_hps_["iter"]++;
 
-        #pragma omp parallel for
-        for (int n = 0; n < in_chunk->num(); ++n) {
-            for (int c = 0; c < in_chunk->channels(); ++c) {
-                const int mindex = mean->offset(0, c, 0, 0);
-                for (int h = 0; h < in_chunk->height(); ++h) {
-                    for (int w = 0; w < in_chunk->width(); ++w) {
-                        const int iindex = in_chunk->offset(n, c, h, w);
-                        out_no_shift_data[iindex] = (in_data[iindex] - mean_data[mindex])
-                                            / std::sqrt(var_data[mindex] + 1e-8f);
-                        out_data[iindex] = gamma_data[mindex] * out_no_shift_data[iindex] + beta_data[mindex];
+        parallel_for(0, in_chunk->num(), [&](int begin, int end) {
+            for (int n = begin; n < end; ++n) {
+                for (int c = 0; c < in_chunk->channels(); ++c) {
+                    const int mindex = mean->offset(0, c, 0, 0);
+                    for (int h = 0; h < in_chunk->height(); ++h) {
+                        for (int w = 0; w < in_chunk->width(); ++w) {
+                            const int iindex = in_chunk->offset(n, c, h, w);
+                            out_no_shift_data[iindex] = (in_data[iindex] - mean_data[mindex])
+                                                / std::sqrt(var_data[mindex] + 1e-8f);
+                            out_data[iindex] = gamma_data[mindex] * out_no_shift_data[iindex] + beta_data[mindex];
+                        }
                     }
                 }
             }
-        }
+        });
     } else {
-        #pragma omp parallel for
-        for (int n = 0; n < in_chunk->num(); ++n) {
-            for (int c = 0; c < in_chunk->channels(); ++c) {
-                const int mindex = running_avg_mean->offset(0, c, 0, 0);
-                for (int h = 0; h < in_chunk->height(); ++h) {
-                    for (int w = 0; w < in_chunk->width(); ++w) {
-                        const int iindex = in_chunk->offset(n, c, h, w);
-                        out_no_shift_data[iindex] = (in_data[iindex] - avg_mean_data[mindex])
-                                            / std::sqrt(avg_var_data[mindex] + 1e-8f);
-                        out_data[iindex] = gamma_data[mindex] * out_no_shift_data[iindex] + beta_data[mindex];
+        parallel_for(0, in_chunk->num(), [&](int begin, int end) {
+            for (int n = begin; n < end; ++n) {
+                for (int c = 0; c < in_chunk->channels(); ++c) {
+                    const int mindex = running_avg_mean->offset(0, c, 0, 0);
+                    for (int h = 0; h < in_chunk->height(); ++h) {
+                        for (int w = 0; w < in_chunk->width(); ++w) {
+                            const int iindex = in_chunk->offset(n, c, h, w);
+                            out_no_shift_data[iindex] = (in_data[iindex] - avg_mean_data[mindex])
+                                                / std::sqrt(avg_var_data[mindex] + 1e-8f);
+                            out_data[iindex] = gamma_data[mindex] * out_no_shift_data[iindex] + beta_data[mindex];
+                        }
                     }
                 }
             }
-        }
+        });
     }
 
     gradient_reset();
@@ -156,47 +160,47 @@ void BatchNormalization::backward() {
     float* beta_diff = beta->diff();
 
     const int m = in_chunk->count() / in_chunk->channels();
-    #pragma omp parallel for
-    for(int c = 0; c < in_chunk->channels(); ++c) {
-        float tmp0 = 0;
-        for (int n = 0; n < in_chunk->num(); ++n) {
-            for (int h = 0; h < in_chunk->height(); ++h) {
-                for (int w = 0; w < in_chunk->width(); ++w) {
-                    const int oindex = out_chunk->offset(n, c, h, w);
-                    out_no_shift_diff[oindex] = gamma_data[c] * out_diff[oindex];
-                    var_diff[c] += out_no_shift_diff[oindex] * (in_data[oindex]-mean_data[c])
-                                   * (-0.5) * std::pow(var_data[c]+1e-8f, -1.5);
-                    mean_diff[c] += (-out_no_shift_diff[oindex]) / std::sqrt(var_data[c]+1e-8f);
-                    tmp0 += 2 * (mean_data[c] - in_data[oindex]);
-
-                    gamma_diff[c] += out_diff[oindex] * out_no_shift_data[oindex];
-                    beta_diff[c] += out_diff[oindex];
+    parallel_for(0, in_chunk->channels(), [&](int begin, int end) {
+        for (int c = begin; c < end; ++c) {
+            float tmp0 = 0;
+            for (int n = 0; n < in_chunk->num(); ++n) {
+                for (int h = 0; h < in_chunk->height(); ++h) {
+                    for (int w = 0; w < in_chunk->width(); ++w) {
+                        const int oindex = out_chunk->offset(n, c, h, w);
+                        out_no_shift_diff[oindex] = gamma_data[c] * out_diff[oindex];
+                        var_diff[c] += out_no_shift_diff[oindex] * (in_data[oindex]-mean_data[c])
+                                       * (-0.5) * std::pow(var_data[c]+1e-8f, -1.5);
+                        mean_diff[c] += (-out_no_shift_diff[oindex]) / std::sqrt(var_data[c]+1e-8f);
+                        tmp0 += 2 * (mean_data[c] - in_data[oindex]);
+
+                        gamma_diff[c] += out_diff[oindex] * out_no_shift_data[oindex];
+                        beta_diff[c] += out_diff[oindex];
+                    }
                 }
             }
+            mean_diff[c] += var_diff[c] * tmp0 / m;
         }
-        mean_diff[c] += var_diff[c] * tmp0 / m;
-    }
+    });
 
-    #pragma omp parallel for
-    for (int n = 0; n < in_chunk->num(); ++n) {
-        for (int c = 0; c < in_chunk->channels(); ++c) {
-            for (int h = 0; h < in_chunk->height(); ++h) {
-                for (int w = 0; w < in_chunk->width(); ++w) {
-                    const int iindex = in_chunk->offset(n, c, h, w);
-                    in_diff[iindex] += (out_no_shift_diff[iindex] / std::sqrt(var_data[c]+1e-8f)
-                                        + 2 * var_diff[c] * (in_data[iindex]-mean_data[c]) / m
-                                        + mean_diff[c] / m);
+    parallel_for(0, in_chunk->num(), [&](int begin, int end) {
+        for (int n = begin; n < end; ++n) {
+            for (int c = 0; c < in_chunk->channels(); ++c) {
+                for (int h = 0; h < in_chunk->height(); ++h) {
+                    for (int w = 0; w < in_chunk->width(); ++w) {
+                        const int iindex = in_chunk->offset(n, c, h, w);
+                        in_diff[iindex] += (out_no_shift_diff[iindex] / std::sqrt(var_data[c]+1e-8f)
+                                            + 2 * var_diff[c] * (in_data[iindex]-mean_data[c]) / m
+                                            + mean_diff[c] / m);
+                    }
                 }
             }
         }
-    }
+    });
 }
 
 void BatchNormalization::initialize() {
-    float* gamma_data = params_[4]->data();
-    float* beta_data = params_[5]->data();
-    normal_random_init(params_[4]->count(), gamma_data, 0.0f, 0.1f);
-    constant_init(params_[5]->count(), beta_data, 0.1f);
+    defer_init(4, "normal", 0.0f, 0.1f);
+    defer_init(5, "constant", 0.1f);
 }
 
 vector<int> BatchNormalization::shape_inference() {
@@ -0,0 +1,215 @@
+/**
+ * @file binarymodel.cpp
+ * @auther yefajie
+ * @data 2026/10/19
+ **/
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <iostream>
+#include <set>
+
+#include "binarymodel.h"
+
+namespace micronet {
+
+static const char BINARY_MAGIC[8] = {'M', 'I', 'C', 'R', 'O', 'N', 'E', 'T'};
+static const uint32_t BINARY_VERSION = 1;
+static const size_t BINARY_PREFIX = 24;
+
+inline size_t align_up(size_t n) {
+    return (n + BLOB_ALIGNMENT - 1) / BLOB_ALIGNMENT * BLOB_ALIGNMENT;
+}
+
+MappedFile::MappedFile(const string& filename): data_(nullptr), size_(0) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        cout << "can not open model file: " << filename << endl;
+        exit(1);
+    }
+    size_ = st.st_size;
+    void* addr = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        cout << "can not map model file: " << filename << endl;
+        exit(1);
+    }
+    data_ = static_cast<char*>(addr);
+}
+
+MappedFile::~MappedFile() {
+    if (data_ != nullptr) {
+        munmap(data_, size_);
+    }
+}
+
+uint16_t float_to_half(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000;
+    int32_t exponent = int32_t((bits >> 23) & 0xff) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffff;
+
+    if (((bits >> 23) & 0xff) == 0xff) {
+        return sign | 0x7c00 | (mantissa? 0x200: 0);
+    }
+    if (exponent >= 31) {
+        return sign | 0x7c00;
+    }
+    if (exponent <= 0) {
+        if (exponent < -10) {
+            return sign;
+        }
+        mantissa |= 0x800000;
+        int shift = 14 - exponent;
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1))) {
+            half++;
+        }
+        return sign | half;
+    }
+    uint32_t half = sign | (exponent << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) {
+        half++;
+    }
+    return half;
+}
+
+float half_to_float(uint16_t value) {
+    uint32_t sign = uint32_t(value & 0x8000) << 16;
+    uint32_t exponent = (value >> 10) & 0x1f;
+    uint32_t mantissa = value & 0x3ff;
+    uint32_t bits;
+    if (exponent == 0x1f) {
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    } else if (exponent != 0) {
+        bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    } else if (mantissa == 0) {
+        bits = sign;
+    } else {
+        exponent = 127 - 15 + 1;
+        while (!(mantissa & 0x400)) {
+            mantissa <<= 1;
+            exponent--;
+        }
+        bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+    }
+    float result;
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+void assign_blob_offsets(json& j_net, const vector<size_t>& counts, bool fp16) {
+    set<string> assigned;
+    size_t offset = 0;
+    int index = 0;
+    for (json& j_layer: j_net["layers"]) {
+        for (json& j_param: j_layer["params"]) {
+            string param_id = j_param["param_id"].get<string>();
+            j_param["dtype"] = fp16? "fp16": "fp32";
+            if (assigned.find(param_id) != assigned.end()) {
+                continue;
+            }
+            assigned.insert(param_id);
+            j_param["offset"] = offset;
+            offset += align_up(counts[index++] * (fp16? sizeof(uint16_t): sizeof(float)));
+        }
+    }
+}
+
+static bool write_all(int fd, const void* data, size_t size) {
+    const char* ptr = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t written = write(fd, ptr, size);
+        if (written <= 0) {
+            return false;
+        }
+        ptr += written;
+        size -= written;
+    }
+    return true;
+}
+
+static bool write_padding(int fd, size_t size) {
+    static const char zeros[BLOB_ALIGNMENT] = {0};
+    return size == 0 || write_all(fd, zeros, size);
+}
+
+bool write_binary_model(const string& save_path, const json& j_net, const vector<ParamBlob>& blobs,
+                        bool fp16, bool sync) {
+    int fd = open(save_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        cout << "can not create model file: " << save_path << endl;
+        return false;
+    }
+    string header = j_net.dump();
+    uint32_t version = BINARY_VERSION, reserved = 0;
+    uint64_t header_size = header.size();
+    bool ok = write_all(fd, BINARY_MAGIC, sizeof(BINARY_MAGIC)) &&
+              write_all(fd, &version, sizeof(version)) &&
+              write_all(fd, &reserved, sizeof(reserved)) &&
+              write_all(fd, &header_size, sizeof(header_size)) &&
+              write_all(fd, header.data(), header.size());
+    size_t position = BINARY_PREFIX + header.size();
+    ok = ok && write_padding(fd, align_up(position) - position);
+
+    vector<uint16_t> halfs;
+    for (const auto& blob: blobs) {
+        size_t bytes;
+        if (fp16) {
+            halfs.resize(blob.count);
+            for (size_t i = 0; i < blob.count; ++i) {
+                halfs[i] = float_to_half(blob.data[i]);
+            }
+            bytes = blob.count * sizeof(uint16_t);
+            ok = ok && write_all(fd, halfs.data(), bytes);
+        } else {
+            bytes = blob.count * sizeof(float);
+            ok = ok && write_all(fd, blob.data, bytes);
+        }
+        ok = ok && write_padding(fd, align_up(bytes) - bytes);
+    }
+    if (sync) {
+        ok = ok && fsync(fd) == 0;
+    }
+    if (close(fd) != 0 || !ok) {
+        cout << "write model file: " << save_path << " failed!" << endl;
+        return false;
+    }
+    return true;
+}
+
+json read_binary_header(const MappedFile& file, size_t& blobs_offset) {
+    uint64_t header_size = 0;
+    if (file.size() < BINARY_PREFIX || memcmp(file.data(), BINARY_MAGIC, sizeof(BINARY_MAGIC)) != 0) {
+        cout << "not a micronet binary model file!" << endl;
+        exit(1);
+    }
+    uint32_t version = 0;
+    memcpy(&version, file.data() + sizeof(BINARY_MAGIC), sizeof(version));
+    if (version != BINARY_VERSION) {
+        cout << "binary model version " << version << " is not supported, expect " << BINARY_VERSION << "!" << endl;
+        exit(1);
+    }
+    memcpy(&header_size, file.data() + 16, sizeof(header_size));
+    if (header_size > file.size() - BINARY_PREFIX || align_up(BINARY_PREFIX + header_size) > file.size()) {
+        cout << "binary model file is truncated!" << endl;
+        exit(1);
+    }
+    const char* header = file.data() + BINARY_PREFIX;
+    blobs_offset = align_up(BINARY_PREFIX + header_size);
+    json j_net = json::parse(header, header + header_size, nullptr, false);
+    if (j_net.is_discarded()) {
+        cout << "binary model header is not valid json!" << endl;
+        exit(1);
+    }
+    return j_net;
+}
+
+} // namespace micronet
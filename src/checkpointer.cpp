@@ -0,0 +1,127 @@
+/**
+ * @file checkpointer.cpp
+ * @auther yefajie
+ * @data 2026/10/19
+ **/
+#include <string.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "checkpointer.h"
+#include "net.h"
+#include "util.h"
+
+namespace micronet {
+
+Checkpointer::Checkpointer(Net* net, const string& path_prefix, int max_to_keep, bool fp16):
+    net_(net), path_prefix_(path_prefix), max_to_keep_(max_to_keep), fp16_(fp16),
+    busy_{false, false}, stop_(false) {
+    writer_ = thread(&Checkpointer::write_loop, this);
+}
+
+Checkpointer::~Checkpointer() {
+    {
+        lock_guard<mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cond_.notify_all();
+    writer_.join();
+}
+
+void Checkpointer::save(int iter) {
+    unique_lock<mutex> lock(mutex_);
+    cond_.wait(lock, [this] {return !busy_[0] || !busy_[1];});
+    int slot = busy_[0]? 1: 0;
+    busy_[slot] = true;
+    lock.unlock();
+
+    Snapshot& snapshot = snapshots_[slot];
+    vector<chunk_ptr> params = net_->unique_params();
+    size_t total = 0;
+    for (const auto& param: params) {
+        total += param->count();
+    }
+    snapshot.data.resize(total);
+    snapshot.blobs.clear();
+    vector<size_t> counts;
+    float* data = snapshot.data.data();
+    for (const auto& param: params) {
+        memcpy(data, param->const_data(), param->count()*sizeof(float));
+        snapshot.blobs.push_back({data, size_t(param->count())});
+        counts.push_back(param->count());
+        data += param->count();
+    }
+    snapshot.header = json();
+    to_json(snapshot.header, net_, false);
+    // hogwild workers save in the middle of an epoch, before the net's iter moves
+    snapshot.header["iter"] = iter;
+    assign_blob_offsets(snapshot.header, counts, fp16_);
+    snapshot.path = path_prefix_ + "-" + to_string(iter) + ".bin";
+
+    lock.lock();
+    pending_.push_back(slot);
+    cond_.notify_all();
+}
+
+void Checkpointer::wait() {
+    unique_lock<mutex> lock(mutex_);
+    cond_.wait(lock, [this] {return !busy_[0] && !busy_[1];});
+}
+
+void Checkpointer::write_loop() {
+    unique_lock<mutex> lock(mutex_);
+    while (true) {
+        cond_.wait(lock, [this] {return stop_ || !pending_.empty();});
+        if (pending_.empty()) {
+            return;
+        }
+        int slot = pending_.front();
+        pending_.pop_front();
+        lock.unlock();
+        bool written = write_snapshot(snapshots_[slot]);
+        lock.lock();
+
+        if (written) {
+            saved_paths_.push_back(snapshots_[slot].path);
+            while (saved_paths_.size() > size_t(max_to_keep_)) {
+                remove(saved_paths_.front().c_str());
+                saved_paths_.pop_front();
+            }
+        }
+        busy_[slot] = false;
+        cond_.notify_all();
+    }
+}
+
+deque<string> Checkpointer::saved_paths() const {
+    lock_guard<mutex> lock(mutex_);
+    return saved_paths_;
+}
+
+bool Checkpointer::write_snapshot(Snapshot& snapshot) {
+    Timer timer;
+    string tmp_path = snapshot.path + ".tmp";
+    // a failed checkpoint keeps the previous ones and training goes on
+    if (!write_binary_model(tmp_path, snapshot.header, snapshot.blobs, fp16_, true)) {
+        cout << "checkpoint " << snapshot.path << " is skipped!" << endl;
+        remove(tmp_path.c_str());
+        return false;
+    }
+    if (rename(tmp_path.c_str(), snapshot.path.c_str()) != 0) {
+        cout << "rename checkpoint " << tmp_path << " failed!" << endl;
+        remove(tmp_path.c_str());
+        return false;
+    }
+    size_t slash = snapshot.path.find_last_of('/');
+    string dir = slash == string::npos? ".": snapshot.path.substr(0, slash + 1);
+    int fd = open(dir.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+    cout << "checkpoint " << snapshot.path << " written in " << timer.elapsed() << " s" << endl;
+    return true;
+}
+
+} // namespace micronet
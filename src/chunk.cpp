@@ -4,50 +4,71 @@
  * @data 2018/6/21
  **/
 #include "chunk.h"
+#include "allocator.h"
+#include "threadpool.h"
 
 namespace micronet {
 
 void Chunk::new_chunk(const vector<int>& shape) {
     delete_chunk();
     shape_ = shape;
-    data_ = new float[count()];
-    diff_ = new float[count()];
+    data_ = allocate_floats(count());
+    diff_ = allocate_floats(count());
     //cout << "new chunk" << endl;
 }
 
 void Chunk::delete_chunk() {
-    if (data_ != nullptr) {
-        delete[] data_;
-        data_ = nullptr;
+    if (data_ != nullptr && data_holder_ == nullptr) {
+        free_floats(data_);
     }
-    if (diff_ != nullptr) {
-        delete[] diff_;
-        diff_ = nullptr;
+    if (diff_ != nullptr && diff_holder_ == nullptr) {
+        free_floats(diff_);
     }
+    data_ = nullptr;
+    diff_ = nullptr;
+    data_holder_.reset();
+    diff_holder_.reset();
     shape_ = {0, 0, 0, 0};
 }
 
+void Chunk::share_data(float* data, const shared_ptr<void>& holder) {
+    if (data_ != nullptr && data_holder_ == nullptr) {
+        free_floats(data_);
+    }
+    data_ = data;
+    data_holder_ = holder;
+}
+
+void Chunk::share_diff(float* diff, const shared_ptr<void>& holder) {
+    if (diff_ != nullptr && diff_holder_ == nullptr) {
+        free_floats(diff_);
+    }
+    diff_ = diff;
+    diff_holder_ = holder;
+}
+
 Chunk::Chunk(): shape_{0, 0, 0, 0}, data_(nullptr), diff_(nullptr) {
 }
 
 Chunk::Chunk(const int n, const int c, const int h, const int w):
-    shape_{n, c, h, w}, data_(new float[count()]), diff_(new float[count()]) {
+    shape_{n, c, h, w}, data_(allocate_floats(count())), diff_(allocate_floats(count())) {
     fill_value(0.0f, 0.0f);
 }
 
 Chunk::Chunk(const vector<int>& shape): shape_(shape),
-    data_(new float[count()]), diff_(new float[count()]) {
+    data_(allocate_floats(count())), diff_(allocate_floats(count())) {
     fill_value(0.0f, 0.0f);
 }
 
-Chunk::Chunk(const Chunk& chunk): shape_(chunk.shape()), data_(new float[count()]), diff_(new float[count()]),
-    in_layers_(chunk.in_layers_), out_layer_(chunk.out_layer_), trainable_(chunk.trainable()) {
+Chunk::Chunk(const Chunk& chunk): in_layers_(chunk.in_layers_), out_layer_(chunk.out_layer_), shape_(chunk.shape()),
+    data_(allocate_floats(count())), diff_(allocate_floats(count())), trainable_(chunk.trainable()) {
     std::copy(chunk.const_data(), chunk.const_data()+chunk.count(), data_);
     std::copy(chunk.const_diff(), chunk.const_diff()+chunk.count(), diff_);
 }
 
-Chunk::Chunk(Chunk&& chunk): shape_(chunk.shape()), data_(chunk.data()), diff_(chunk.diff()),
-    in_layers_(chunk.in_layers_), out_layer_(chunk.out_layer_), trainable_(chunk.trainable()) {
+Chunk::Chunk(Chunk&& chunk): in_layers_(chunk.in_layers_), out_layer_(chunk.out_layer_), shape_(chunk.shape()),
+    data_(chunk.data()), diff_(chunk.diff()),
+    data_holder_(std::move(chunk.data_holder_)), diff_holder_(std::move(chunk.diff_holder_)), trainable_(chunk.trainable()) {
     chunk.shape_ = {0, 0, 0, 0};
     chunk.data_ = nullptr;
     chunk.diff_ = nullptr;
@@ -76,10 +97,12 @@ Chunk& Chunk::operator=(Chunk&& chunk) {
         trainable_ = chunk.trainable();
         data_ = chunk.data();
         diff_ = chunk.diff();
+        data_holder_ = std::move(chunk.data_holder_);
+        diff_holder_ = std::move(chunk.diff_holder_);
 
         chunk.shape_ = {0, 0, 0, 0};
         chunk.data_ = nullptr;
-        chunk.data_ = nullptr;
+        chunk.diff_ = nullptr;
     }
     return *this;
 }
@@ -124,8 +147,19 @@ void Chunk::copy_from(const Chunk& source) {
 }
 
 void Chunk::fill_value(const float data_value, const float diff_value) {
-    std::fill(data_, data_+count(), data_value);
-    std::fill(diff_, diff_+count(), diff_value);
+    // pool threads touch large buffers first, so under first touch their
+    // pages land on the nodes of the workers that later split the same ranges.
+    // Building a chunk never starts the pool, ProcessGroup::launch has to run
+    // before it does.
+    if (count() < ELEMENTWISE_GRAIN || !thread_pool_started()) {
+        std::fill(data_, data_ + count(), data_value);
+        std::fill(diff_, diff_ + count(), diff_value);
+        return;
+    }
+    parallel_for(0, count(), [&](int begin, int end) {
+        std::fill(data_ + begin, data_ + end, data_value);
+        std::fill(diff_ + begin, diff_ + end, diff_value);
+    }, ELEMENTWISE_GRAIN);
 }
 
 const vector<int> Chunk::shape() const {
@@ -32,59 +32,68 @@ ClassifyNet::ClassifyNet(chunk_ptr (*graph_constructor)(const chunk_ptr&), const
 }
 
 void ClassifyNet::fit(const map<string, data_t>& train_data, const map<string, data_t>& valid_data,
-                      int batch_size, int epochs, int verbose, bool shuffle) {
+                      int batch_size, int epochs, int verbose, bool shuffle,
+                      int accumulation_steps) {
     if (!net_initialized_) {
         cout << "net need to be initialized first!" << endl;
         exit(1);
     }
+    materialize_params();
     if (!optimizer_) {
         cout << "optimizer must be assigned!" << endl;
         exit(1);
     }
-    if (train_data.find("img") == train_data.end()) {
+    if (!has_data(train_data, "img")) {
         cout << "train img data must be specified!" << endl;
         exit(1);
     }
-    if (train_data.find("label") == train_data.end()) {
+    if (!has_data(train_data, "label")) {
         cout << "train label data must be specified!" << endl;
         exit(1);
     }
-    if (valid_data.find("img") == valid_data.end()) {
+    if (!has_data(valid_data, "img")) {
         cout << "valid img data must be specified!" << endl;
         exit(1);
     }
-    if (valid_data.find("label") == valid_data.end()) {
+    if (!has_data(valid_data, "label")) {
         cout << "valid label data must be specified!" << endl;
         exit(1);
     }
-    vector<data_t> train_data_vec = {train_data.at("img"), train_data.at("label")};
-    vector<data_t> valid_data_vec = {valid_data.at("img"), valid_data.at("label")};
-    DataProvider train(train_data_vec, shuffle);
-    DataProvider valid(valid_data_vec, false);  //cout << "shit\n";
+    if (hogwild_ && accumulation_steps > 1) {
+        cout << "hogwild training can not accumulate gradients!" << endl;
+        exit(1);
+    }
+    auto train = make_provider(train_data, {"img", "label"}, shuffle, true, true);
 
-    int train_num_examples = train.num_samples();
-    int train_num_fit_iters = train_num_examples * epochs / batch_size;
+    // every step accumulates accumulation_steps micro batches of batch_size
+    int step_size = batch_size * max(1, accumulation_steps);
+    int train_num_examples = train->num_samples();
+    int train_num_fit_iters = train_num_examples * epochs / step_size;
     optimizer_->total_iters_ = train_num_fit_iters;
 
-    int steps_per_epoch = train_num_examples / batch_size;
+    int steps_per_epoch = train_num_examples / step_size;
     for (int epo = 0; epo < epochs; ++epo) {
         cout << "==================== epoch: " << epo+1 << " starts =================" << endl;
         //iter_++;
         float train_loss = 0;
         float train_acc = 0;
         Timer epoch_timer, step_timer;
-        for (int step = 0; step < steps_per_epoch; ++step) {
-            step_timer.resume();
-            train.load_batch(inputs_, batch_size);
-            forward(true);
-            backward();
-            update();
-            float loss = key_chunks_["loss"]->const_data()[0];
-            float acc = key_chunks_["acc"]->const_data()[0];
-            train_loss += loss;
-            train_acc += acc;
-            if (step % verbose == 0) {
-                print_loss_acc(step, steps_per_epoch, loss, acc, step_timer.elapsed());
+        if (hogwild_) {
+            map<string, float> sums = hogwild_epoch(*train, batch_size, steps_per_epoch);
+            train_loss = sums["loss"];
+            train_acc = sums["acc"];
+        } else {
+            for (int step = 0; step < steps_per_epoch; ++step) {
+                step_timer.resume();
+                train_step(*train, batch_size, accumulation_steps);
+                checkpoint_step();
+                float loss = key_chunks_["loss"]->const_data()[0];
+                float acc = key_chunks_["acc"]->const_data()[0];
+                train_loss += loss;
+                train_acc += acc;
+                if (step % verbose == 0) {
+                    print_loss_acc(step, steps_per_epoch, loss, acc, step_timer.elapsed());
+                }
             }
         }
         train_loss /= steps_per_epoch;
@@ -110,24 +119,24 @@ void ClassifyNet::evaluate(const map<string, data_t>& data, int batch_size) {
         cout << "net need to be initialized first!" << endl;
         exit(1);
     }
-    if (data.find("img") == data.end()) {
+    materialize_params();
+    if (!has_data(data, "img")) {
         cout << "img data must be specified!" << endl;
         exit(1);
     }
-    if (data.find("label") == data.end()) {
+    if (!has_data(data, "label")) {
         cout << "label data must be specified!" << endl;
         exit(1);
     }
 
     Timer timer;
-    vector<data_t> data_vec {data.at("img"), data.at("label")};
-    DataProvider eval(data_vec, false);
-    int eval_fit_steps = eval.num_samples() / batch_size;
-    int size_remain = eval.num_samples() % batch_size;
+    auto eval = make_provider(data, {"img", "label"}, false, false);
+    int eval_fit_steps = eval->num_samples() / batch_size;
+    int size_remain = eval->num_samples() % batch_size;
     float eval_loss = 0;
     float eval_acc = 0;
     for (int step = 0; step < eval_fit_steps; ++step) {
-        eval.load_batch(inputs_, batch_size);
+        eval->load_batch(inputs_, batch_size);
         //cout << step << endl;
         forward(false);
         float loss = key_chunks_["loss"]->const_data()[0];
@@ -136,7 +145,7 @@ void ClassifyNet::evaluate(const map<string, data_t>& data, int batch_size) {
         eval_acc += acc * batch_size;
     }
     if (size_remain) {
-        eval.load_batch(inputs_, size_remain);
+        eval->load_batch(inputs_, size_remain);
         //cout << step << endl;
         forward(false);
         float loss = key_chunks_["loss"]->const_data()[0];
@@ -144,8 +153,8 @@ void ClassifyNet::evaluate(const map<string, data_t>& data, int batch_size) {
         eval_loss += loss * size_remain;
         eval_acc += acc * size_remain;
     }
-    eval_loss /= eval.num_samples();
-    eval_acc /= eval.num_samples();
+    eval_loss /= eval->num_samples();
+    eval_acc /= eval->num_samples();
     cout << "eval loss: " << eval_loss << ", eval acc: " << eval_acc <<
             ", time used: " << fixed << setprecision(4) << timer.elapsed() << "s" << endl;
 }
@@ -155,34 +164,28 @@ data_t ClassifyNet::inference(const map<string, data_t>& data, int batch_size) {
         cout << "net need to be initialized first!" << endl;
         exit(1);
     }
-    if (data.find("img") == data.end()) {
+    materialize_params();
+    if (!has_data(data, "img")) {
         cout << "img data must be specified!" << endl;
         exit(1);
     }
 
     Timer timer;
-    vector<data_t> data_vec {data.at("img")};
-    DataProvider infer(data_vec, false);
-    data_t data_inference;
-
-    int infer_steps = infer.num_samples() / batch_size;
-    int size_remain = infer.num_samples() % batch_size;
-    for (int step = 0; step < infer_steps; ++step) {
-        infer.load_batch({key_chunks_["img"]}, batch_size);
-        key_chunks_["label"]->reshape(batch_size, 1, 1, 1);
-        forward(false);
-        const float* argmax_data = key_chunks_["argmax"]->const_data();
-        for (int i = 0; i < batch_size; ++i) {
-            data_inference.push_back({argmax_data[i]});
+    auto infer = make_provider(data, {"img"}, false, false);
+    data_t data_inference(infer->num_samples(), vector<float>(1));
+
+    int infer_steps = infer->num_samples() / batch_size;
+    int size_remain = infer->num_samples() % batch_size;
+    for (int step = 0; step <= infer_steps; ++step) {
+        int step_size = step < infer_steps? batch_size: size_remain;
+        if (step_size == 0) {
+            break;
         }
-    }
-    if (size_remain) {
-        infer.load_batch({key_chunks_["img"]}, size_remain);
-        key_chunks_["label"]->reshape(size_remain, 1, 1, 1);
-        forward(false);
+        infer->load_batch({key_chunks_["img"]}, step_size);
+        forward_inference("argmax");
         const float* argmax_data = key_chunks_["argmax"]->const_data();
-        for (int i = 0; i < size_remain; ++i) {
-            data_inference.push_back({argmax_data[i]});
+        for (int i = 0; i < step_size; ++i) {
+            data_inference[step * batch_size + i][0] = argmax_data[i];
         }
     }
     cout << "time used: " << timer.elapsed() << " s" << endl;
@@ -192,13 +195,7 @@ data_t ClassifyNet::inference(const map<string, data_t>& data, int batch_size) {
 
 void ClassifyNet::forward(bool is_train, const string& layer_prefix) {
     //Timer t1;
-    for (auto layer = net_sequences_.begin(); layer != net_sequences_.end(); ++layer) {
-        Timer timer;
-        (*layer)->forward(is_train);
-        //if (iter_ % 100 == 0)
-        //    cout << (*layer)->layer_name_ << endl;
-        layer_op_time_[(*layer)->layer_name_].first = timer.elapsed()*1000;
-    }
+    execute_forward(is_train);
     //if (iter_ % 100 == 0) {
     //    cout << "forward: " << t1.elapsed()*1000 << endl;
     //}
@@ -206,13 +203,7 @@ void ClassifyNet::forward(bool is_train, const string& layer_prefix) {
 
 void ClassifyNet::backward(const string& layer_prefix) {
     //Timer t1;
-    for (auto layer = net_sequences_.rbegin(); layer != net_sequences_.rend(); ++layer) {
-        Timer timer;
-        (*layer)->backward();
-        //if (iter_ % 100 == 0)
-        //    cout << (*layer)->layer_name_ << endl;
-        layer_op_time_[(*layer)->layer_name_].second = timer.elapsed()*1000;
-    }
+    execute_backward();
     //if (iter_ % 100 == 0) {
     //    cout << "backward: " << t1.elapsed()*1000 << endl;
     //}
@@ -221,6 +212,10 @@ void ClassifyNet::backward(const string& layer_prefix) {
 void ClassifyNet::update(const string& layer_prefix) {
     //Timer t1;
     iter_++;
+    if (param_arena_) {
+        step_arena();
+        return;
+    }
     for (auto& layer: net_sequences_) {
         Timer timer;
         for (auto& param: layer->params_) {
@@ -1,5 +1,5 @@
-#include <omp.h>
 #include "concatenate.h"
+#include "threadpool.h"
 
 namespace micronet {
 
@@ -54,67 +54,71 @@ void Concatenate::forward(bool is_train) {
         const float* in_data = chunk->const_data();
         switch(axis) {
             case 0:
-                #pragma omp parallel for
-                for (int n = 0; n < chunk->num(); ++n) {
-                    const int n_out = num_out + n;
-                    for (int c = 0; c < chunk->channels(); ++c) {
-                        for (int h = 0; h < chunk->height(); ++h) {
-                            for (int w = 0; w < chunk->width(); ++w) {
-                                const int iindex = chunk->offset(n, c, h, w);
-                                const int oindex = chunk_out->offset(n_out, c, h, w);
-                                out_data[oindex] = in_data[iindex];
+                parallel_for(0, chunk->num(), [&](int begin, int end) {
+                    for (int n = begin; n < end; ++n) {
+                        const int n_out = num_out + n;
+                        for (int c = 0; c < chunk->channels(); ++c) {
+                            for (int h = 0; h < chunk->height(); ++h) {
+                                for (int w = 0; w < chunk->width(); ++w) {
+                                    const int iindex = chunk->offset(n, c, h, w);
+                                    const int oindex = chunk_out->offset(n_out, c, h, w);
+                                    out_data[oindex] = in_data[iindex];
+                                }
                             }
                         }
                     }
-                }
+                });
                 num_out += chunk->num();
                 break;
             case 1:
-                #pragma omp parallel for
-                for (int n = 0; n < chunk->num(); ++n) {
-                    for (int c = 0; c < chunk->channels(); ++c) {
-                        const int c_out = channels_out + c;
-                        for (int h = 0; h < chunk->height(); ++h) {
-                            for (int w = 0; w < chunk->width(); ++w) {
-                                const int iindex = chunk->offset(n, c, h, w);
-                                const int oindex = chunk_out->offset(n, c_out, h, w);
-                                out_data[oindex] = in_data[iindex];
+                parallel_for(0, chunk->num(), [&](int begin, int end) {
+                    for (int n = begin; n < end; ++n) {
+                        for (int c = 0; c < chunk->channels(); ++c) {
+                            const int c_out = channels_out + c;
+                            for (int h = 0; h < chunk->height(); ++h) {
+                                for (int w = 0; w < chunk->width(); ++w) {
+                                    const int iindex = chunk->offset(n, c, h, w);
+                                    const int oindex = chunk_out->offset(n, c_out, h, w);
+                                    out_data[oindex] = in_data[iindex];
+                                }
                             }
                         }
                     }
-                }
+                });
                 channels_out += chunk->channels();
                 break;
             case 2:
-                #pragma omp parallel for
-                for (int n = 0; n < chunk->num(); ++n) {
-                    for (int c = 0; c < chunk->channels(); ++c) {
-                        for (int h = 0; h < chunk->height(); ++h) {
-                            const int h_out = height_out + h;
-                            for (int w = 0; w < chunk->width(); ++w) {
-                                const int iindex = chunk->offset(n, c, h, w);
-                                const int oindex = chunk_out->offset(n, c, h_out, w);
-                                out_data[oindex] = in_data[iindex];
+                parallel_for(0, chunk->num(), [&](int begin, int end) {
+                    for (int n = begin; n < end; ++n) {
+                        for (int c = 0; c < chunk->channels(); ++c) {
+                            for (int h = 0; h < chunk->height(); ++h) {
+                                const int h_out = height_out + h;
+                                for (int w = 0; w < chunk->width(); ++w) {
+                                    const int iindex = chunk->offset(n, c, h, w);
+                                    const int oindex = chunk_out->offset(n, c, h_out, w);
+                                    out_data[oindex] = in_data[iindex];
+                                }
                             }
                         }
                     }
-                }
+                });
                 height_out += chunk->height();
                 break;
             case 3:
-                #pragma omp parallel for
-                for (int n = 0; n < chunk->num(); ++n) {
-                    for (int c = 0; c < chunk->channels(); ++c) {
-                        for (int h = 0; h < chunk->height(); ++h) {
-                            for (int w = 0; w < chunk->width(); ++w) {
-                                const int w_out = width_out + w;
-                                const int iindex = chunk->offset(n, c, h, w);
-                                const int oindex = chunk_out->offset(n, c, h, w_out);
-                                out_data[oindex] = in_data[iindex];
+                parallel_for(0, chunk->num(), [&](int begin, int end) {
+                    for (int n = begin; n < end; ++n) {
+                        for (int c = 0; c < chunk->channels(); ++c) {
+                            for (int h = 0; h < chunk->height(); ++h) {
+                                for (int w = 0; w < chunk->width(); ++w) {
+                                    const int w_out = width_out + w;
+                                    const int iindex = chunk->offset(n, c, h, w);
+                                    const int oindex = chunk_out->offset(n, c, h, w_out);
+                                    out_data[oindex] = in_data[iindex];
+                                }
                             }
                         }
                     }
-                }
+                });
                 width_out += chunk->width();
         }
     }
@@ -132,67 +136,71 @@ void Concatenate::backward() {
         float* in_diff = chunk->diff();
         switch(axis) {
             case 0:
-                #pragma omp parallel for
-                for (int n = 0; n < chunk->num(); ++n) {
-                    const int n_out = num_out + n;
-                    for (int c = 0; c < chunk->channels(); ++c) {
-                        for (int h = 0; h < chunk->height(); ++h) {
-                            for (int w = 0; w < chunk->width(); ++w) {
-                                const int iindex = chunk->offset(n, c, h, w);
-                                const int oindex = chunk_out->offset(n_out, c, h, w);
-                                in_diff[iindex] += out_diff[oindex];
+                parallel_for(0, chunk->num(), [&](int begin, int end) {
+                    for (int n = begin; n < end; ++n) {
+                        const int n_out = num_out + n;
+                        for (int c = 0; c < chunk->channels(); ++c) {
+                            for (int h = 0; h < chunk->height(); ++h) {
+                                for (int w = 0; w < chunk->width(); ++w) {
+                                    const int iindex = chunk->offset(n, c, h, w);
+                                    const int oindex = chunk_out->offset(n_out, c, h, w);
+                                    in_diff[iindex] += out_diff[oindex];
+                                }
                             }
                         }
                     }
-                }
+                });
                 num_out += chunk->num();
                 break;
             case 1:
-                #pragma omp parallel for
-                for (int n = 0; n < chunk->num(); ++n) {
-                    for (int c = 0; c < chunk->channels(); ++c) {
-                        const int c_out = channels_out + c;
-                        for (int h = 0; h < chunk->height(); ++h) {
-                            for (int w = 0; w < chunk->width(); ++w) {
-                                const int iindex = chunk->offset(n, c, h, w);
-                                const int oindex = chunk_out->offset(n, c_out, h, w);
-                                in_diff[iindex] += out_diff[oindex];
+                parallel_for(0, chunk->num(), [&](int begin, int end) {
+                    for (int n = begin; n < end; ++n) {
+                        for (int c = 0; c < chunk->channels(); ++c) {
+                            const int c_out = channels_out + c;
+                            for (int h = 0; h < chunk->height(); ++h) {
+                                for (int w = 0; w < chunk->width(); ++w) {
+                                    const int iindex = chunk->offset(n, c, h, w);
+                                    const int oindex = chunk_out->offset(n, c_out, h, w);
+                                    in_diff[iindex] += out_diff[oindex];
+                                }
                             }
                         }
                     }
-                }
+                });
                 channels_out += chunk->channels();
                 break;
             case 2:
-                #pragma omp parallel for
-                for (int n = 0; n < chunk->num(); ++n) {
-                    for (int c = 0; c < chunk->channels(); ++c) {
-                        for (int h = 0; h < chunk->height(); ++h) {
-                            const int h_out = height_out + h;
-                            for (int w = 0; w < chunk->width(); ++w) {
-                                const int iindex = chunk->offset(n, c, h, w);
-                                const int oindex = chunk_out->offset(n, c, h_out, w);
-                                in_diff[iindex] += out_diff[oindex];
+                parallel_for(0, chunk->num(), [&](int begin, int end) {
+                    for (int n = begin; n < end; ++n) {
+                        for (int c = 0; c < chunk->channels(); ++c) {
+                            for (int h = 0; h < chunk->height(); ++h) {
+                                const int h_out = height_out + h;
+                                for (int w = 0; w < chunk->width(); ++w) {
+                                    const int iindex = chunk->offset(n, c, h, w);
+                                    const int oindex = chunk_out->offset(n, c, h_out, w);
+                                    in_diff[iindex] += out_diff[oindex];
+                                }
                             }
                         }
                     }
-                }
+                });
                 height_out += chunk->height();
                 break;
             case 3:
-                #pragma omp parallel for
-                for (int n = 0; n < chunk->num(); ++n) {
-                    for (int c = 0; c < chunk->channels(); ++c) {
-                        for (int h = 0; h < chunk->height(); ++h) {
-                            for (int w = 0; w < chunk->width(); ++w) {
-                                int w_out = width_out + w;
-                                const int iindex = chunk->offset(n, c, h, w);
-                                const int oindex = chunk_out->offset(n, c, h, w_out);
-                                in_diff[iindex] += out_diff[oindex];
+                parallel_for(0, chunk->num(), [&](int begin, int end) {
+                    for (int n = begin; n < end; ++n) {
+                        for (int c = 0; c < chunk->channels(); ++c) {
+                            for (int h = 0; h < chunk->height(); ++h) {
+                                for (int w = 0; w < chunk->width(); ++w) {
+                                    int w_out = width_out + w;
+                                    const int iindex = chunk->offset(n, c, h, w);
+                                    const int oindex = chunk_out->offset(n, c, h, w_out);
+                                    in_diff[iindex] += out_diff[oindex];
+                                }
                             }
                         }
                     }
-                }
+                });
                 width_out += chunk->width();
         }
     }
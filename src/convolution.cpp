@@ -8,11 +8,11 @@
 #include <iostream>
 #include <thread>
 #include <string.h>
-#include <omp.h>
 
 #include "convolution.h"
 #include "util.h"
 #include "math_func.h"
+#include "threadpool.h"
 
 namespace micronet {
 
@@ -118,26 +118,28 @@ void Convolution::forward(bool is_train) {
         output_data += output_channels * output_h * output_w;
     }*/
 
-    #pragma omp parallel for
-    for (int n = 0; n < num; ++n) {
-        const float* input_data_tmp = input_data + n * input_channels * input_h * input_w;
-        float* output_data_tmp = output_data + n * output_channels * output_h * output_w;
-        Chunk col_tmp(input_channels*kernel_h*kernel_w, output_h*output_w, 1, 1);
-        Chunk all_one_tmp(output_h, output_w, 1, 1);
-        all_one_tmp.fill_value(1.0f, 1.0f);
-        float* col_data = col_tmp.data();
-        const float* all_one_data = all_one_tmp.const_data();
-
-        img2col(input_data_tmp, input_channels, input_h, input_w, kernel_h, kernel_w,
-                pad_h, pad_w, stride_h, stride_w, col_data);
-
-        gemm(0, 0, output_channels, output_h*output_w, input_channels*kernel_h*kernel_w, 1,
-             weights_data, input_channels*kernel_h*kernel_w, col_data, output_h*output_w, 0,
-             output_data_tmp, output_h*output_w);
-        gemm(0, 0, output_channels, output_h*output_w, 1, 1,
-             bias_data, 1, all_one_data, output_h*output_w, 1,
-             output_data_tmp, output_h*output_w);
-    }
+    // batch level when there is a sample per thread, else the gemms get the threads
+    parallel_for(0, num, [&](int begin, int end) {
+        for (int n = begin; n < end; ++n) {
+            const float* input_data_tmp = input_data + n * input_channels * input_h * input_w;
+            float* output_data_tmp = output_data + n * output_channels * output_h * output_w;
+            Chunk col_tmp(input_channels*kernel_h*kernel_w, output_h*output_w, 1, 1);
+            Chunk all_one_tmp(output_h, output_w, 1, 1);
+            all_one_tmp.fill_value(1.0f, 1.0f);
+            float* col_data = col_tmp.data();
+            const float* all_one_data = all_one_tmp.const_data();
+
+            img2col(input_data_tmp, input_channels, input_h, input_w, kernel_h, kernel_w,
+                    pad_h, pad_w, stride_h, stride_w, col_data);
+
+            gemm(0, 0, output_channels, output_h*output_w, input_channels*kernel_h*kernel_w, 1,
+                 weights_data, input_channels*kernel_h*kernel_w, col_data, output_h*output_w, 0,
+                 output_data_tmp, output_h*output_w);
+            gemm(0, 0, output_channels, output_h*output_w, 1, 1,
+                 bias_data, 1, all_one_data, output_h*output_w, 1,
+                 output_data_tmp, output_h*output_w);
+        }
+    }, batch_parallel(num)? 1: num);
     //cout << "conv forward time:" << timer_for.elapsed()*1000 << endl;
     //exit(0);
     gradient_reset();
@@ -199,54 +201,67 @@ void Convolution::backward() {
         output_diff += output_channels * output_h * output_w;
     }*/
 
-    vector<Chunk> weights_tmp(num, *params_[0]), bias_tmp(num, *params_[1]);
-    #pragma omp parallel for
-    for (int n = 0; n < num; ++n) {
-        const float* input_data_tmp = input_data + n * input_channels * input_h * input_w;
-        float* input_diff_tmp = input_diff + n * input_channels * input_h * input_w;
-        const float* output_diff_tmp = output_diff + n * output_channels * output_h * output_w;
-
-        Chunk col_tmp(input_channels*kernel_h*kernel_w, output_h*output_w, 1, 1);
-        Chunk all_one_tmp(output_h, output_w, 1, 1);
-        all_one_tmp.fill_value(1.0f, 1.0f);
-        float* col_data = col_tmp.data();
-        float* col_diff = col_tmp.diff();
-        const float* all_one_data = all_one_tmp.const_data();
-        img2col(input_data_tmp, input_channels, input_h, input_w, kernel_h, kernel_w,
-                pad_h, pad_w, stride_h, stride_w, col_data);
-
-        gemm(0, 1, output_channels, input_channels*kernel_h*kernel_w, output_h*output_w, 1,
-             output_diff_tmp, output_h*output_w, col_data, output_h*output_w, 1,
-             weights_tmp[n].diff(), input_channels*kernel_h*kernel_w);
-        gemm(0, 1, output_channels, 1, output_h*output_w, 1,
-             output_diff_tmp, output_h*output_w, all_one_data, output_h*output_w, 1,
-             bias_tmp[n].diff(), 1);
-        gemm(1, 0, input_channels*kernel_h*kernel_w, output_h*output_w, output_channels, 1,
-             weights_data, input_channels*kernel_h*kernel_w, output_diff_tmp, output_h*output_w, 0,
-            col_diff, output_h*output_w);
-        col2img(col_diff, input_channels, input_h, input_w, kernel_h, kernel_w,
-             pad_h, pad_w, stride_h, stride_w, input_diff_tmp);
-    }
-    for (const auto& chunk: weights_tmp) {
-        const float* diff = chunk.const_diff();
-        for (int i = 0; i < chunk.count(); ++i) {
-            weights_diff[i] += diff[i];
+    vector<int> weights_shape = params_[0]->shape();
+    vector<int> bias_shape = params_[1]->shape();
+    TaskGroup tasks(ThreadPool::instance());
+    run_param_grads(tasks, [=] {
+        // per sample partials start from zero, the param diffs may already
+        // hold gradients of shared layers or earlier micro batches
+        vector<Chunk> weights_tmp(num, Chunk(weights_shape)), bias_tmp(num, Chunk(bias_shape));
+        parallel_for(0, num, [&](int begin, int end) {
+            for (int n = begin; n < end; ++n) {
+                const float* input_data_tmp = input_data + n * input_channels * input_h * input_w;
+                const float* output_diff_tmp = output_diff + n * output_channels * output_h * output_w;
+
+                Chunk col_tmp(input_channels*kernel_h*kernel_w, output_h*output_w, 1, 1);
+                Chunk all_one_tmp(output_h, output_w, 1, 1);
+                all_one_tmp.fill_value(1.0f, 1.0f);
+                float* col_data = col_tmp.data();
+                const float* all_one_data = all_one_tmp.const_data();
+                img2col(input_data_tmp, input_channels, input_h, input_w, kernel_h, kernel_w,
+                        pad_h, pad_w, stride_h, stride_w, col_data);
+
+                gemm(0, 1, output_channels, input_channels*kernel_h*kernel_w, output_h*output_w, 1,
+                     output_diff_tmp, output_h*output_w, col_data, output_h*output_w, 1,
+                     weights_tmp[n].diff(), input_channels*kernel_h*kernel_w);
+                gemm(0, 1, output_channels, 1, output_h*output_w, 1,
+                     output_diff_tmp, output_h*output_w, all_one_data, output_h*output_w, 1,
+                     bias_tmp[n].diff(), 1);
+            }
+        }, batch_parallel(num)? 1: num);
+        for (const auto& chunk: weights_tmp) {
+            const float* diff = chunk.const_diff();
+            for (int i = 0; i < chunk.count(); ++i) {
+                weights_diff[i] += diff[i];
+            }
         }
-    }
-    for (const auto& chunk: bias_tmp) {
-        const float* diff = chunk.const_diff();
-        for (int i = 0; i < chunk.count(); ++i) {
-            bias_diff[i] += diff[i];
+        for (const auto& chunk: bias_tmp) {
+            const float* diff = chunk.const_diff();
+            for (int i = 0; i < chunk.count(); ++i) {
+                bias_diff[i] += diff[i];
+            }
         }
-    }
+    });
+
+    parallel_for(0, num, [&](int begin, int end) {
+        for (int n = begin; n < end; ++n) {
+            float* input_diff_tmp = input_diff + n * input_channels * input_h * input_w;
+            const float* output_diff_tmp = output_diff + n * output_channels * output_h * output_w;
+
+            Chunk col_tmp(input_channels*kernel_h*kernel_w, output_h*output_w, 1, 1);
+            float* col_diff = col_tmp.diff();
+            gemm(1, 0, input_channels*kernel_h*kernel_w, output_h*output_w, output_channels, 1,
+                 weights_data, input_channels*kernel_h*kernel_w, output_diff_tmp, output_h*output_w, 0,
+                col_diff, output_h*output_w);
+            col2img(col_diff, input_channels, input_h, input_w, kernel_h, kernel_w,
+                 pad_h, pad_w, stride_h, stride_w, input_diff_tmp);
+        }
+    }, batch_parallel(num)? 1: num);
 }
 
 void Convolution::initialize() {
-    float* weights_data = params_[0]->data();
-    float* bias_data = params_[1]->data();
-
-    normal_random_init(params_[0]->count(), weights_data, flt_hps_["init_mean"], flt_hps_["init_stddev"]);
-    constant_init(params_[1]->count(), bias_data, flt_hps_["init_bias_value"]);
+    defer_init(0, "normal", flt_hps_["init_mean"], flt_hps_["init_stddev"]);
+    defer_init(1, "constant", flt_hps_["init_bias_value"]);
 }
 
 void Convolution::pad_inference() {
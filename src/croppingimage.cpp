@@ -1,5 +1,5 @@
-#include <omp.h>
 #include "croppingimage.h"
+#include "threadpool.h"
 
 namespace micronet {
 
@@ -40,18 +40,19 @@ void CroppingImage::forward(bool is_train) {
 
     chunk_ptr in_chunk = chunks_in_[0];
     chunk_ptr out_chunk = chunks_out_[0];
-    #pragma omp parallel for
-    for (int n = 0; n < num; ++n) {
-        for (int c = 0; c < channels; ++c) {
-            for (int row = 0; row < output_shape[2]; ++row) {
-                for (int col = 0; col < output_shape[3]; ++col) {
-                    const int iindex = in_chunk->offset(n, c, row+cropping_top, col+cropping_left);
-                    const int oindex = out_chunk->offset(n, c, row, col);
-                    output_data[oindex] = input_data[iindex];
+    parallel_for(0, num, [&](int begin, int end) {
+        for (int n = begin; n < end; ++n) {
+            for (int c = 0; c < channels; ++c) {
+                for (int row = 0; row < output_shape[2]; ++row) {
+                    for (int col = 0; col < output_shape[3]; ++col) {
+                        const int iindex = in_chunk->offset(n, c, row+cropping_top, col+cropping_left);
+                        const int oindex = out_chunk->offset(n, c, row, col);
+                        output_data[oindex] = input_data[iindex];
+                    }
                 }
             }
         }
-    }
+    });
 
     gradient_reset();
 }
@@ -69,18 +70,19 @@ void CroppingImage::backward() {
 
     chunk_ptr in_chunk = chunks_in_[0];
     chunk_ptr out_chunk = chunks_out_[0];
-    #pragma omp parallel for
-    for (int n = 0; n < num; ++n) {
-        for (int c = 0; c < channels; ++c) {
-            for (int row = 0; row < output_shape[2]; ++row) {
-                for (int col = 0; col < output_shape[3]; ++col) {
-                    const int iindex = in_chunk->offset(n, c, row+cropping_top, col+cropping_left);
-                    const int oindex = out_chunk->offset(n, c, row, col);
-                    input_diff[iindex] += output_diff[oindex];
+    parallel_for(0, num, [&](int begin, int end) {
+        for (int n = begin; n < end; ++n) {
+            for (int c = 0; c < channels; ++c) {
+                for (int row = 0; row < output_shape[2]; ++row) {
+                    for (int col = 0; col < output_shape[3]; ++col) {
+                        const int iindex = in_chunk->offset(n, c, row+cropping_top, col+cropping_left);
+                        const int oindex = out_chunk->offset(n, c, row, col);
+                        input_diff[iindex] += output_diff[oindex];
+                    }
                 }
             }
         }
-    }
+    });
 }
 
 vector<int> CroppingImage::shape_inference() {
@@ -4,55 +4,132 @@
  * @data 2018/6/22
  **/
 #include <string.h>
+#include <numeric>
 
 #include "dataprovider.h"
 #include "util.h"
+#include "threadpool.h"
 
 namespace micronet {
 
 DataProvider::DataProvider(vector<data_t>& data_vec, bool shuffle):
-    data_vec_(std::move(data_vec)), shuffle_(shuffle), index_in_epoch_(0) {
+    data_vec_(std::move(data_vec)), shuffle_(shuffle), augment_(false), index_in_epoch_(0) {
     num_samples_ = data_vec_[0].size();
+    order_.resize(num_samples_);
+    iota(order_.begin(), order_.end(), 0);
+    if (shuffle_) {
+        shuffle_data();
+    }
+}
+
+DataProvider::DataProvider(vector<data_t>& data_vec, const vector<DataStage>& stages, bool shuffle, bool augment):
+    data_vec_(std::move(data_vec)), stages_(stages), shuffle_(shuffle), augment_(augment), index_in_epoch_(0),
+    seed_generator_(chrono::system_clock::now().time_since_epoch().count()) {
+    num_samples_ = data_vec_[0].size();
+    order_.resize(num_samples_);
+    iota(order_.begin(), order_.end(), 0);
     if (shuffle_) {
         shuffle_data();
     }
 }
 
 void DataProvider::load_batch(const vector<chunk_ptr>& chunks_in, int batch_size) {
+    next_batch(batch_size, batch_);
+    load_batch(chunks_in, batch_);
+}
+
+void DataProvider::next_batch(int batch_size, Batch& batch) {
     if (index_in_epoch_ + batch_size > num_samples_) {
         if (shuffle_) {
             shuffle_data();
         }
         index_in_epoch_ = 0;
     }
-    int load_start = index_in_epoch_;
-    int load_end = load_start + batch_size;
+    batch.samples.assign(order_.begin() + index_in_epoch_, order_.begin() + index_in_epoch_ + batch_size);
     index_in_epoch_ += batch_size;
 
-    for (int i = 0; i < chunks_in.size(); ++i) {
+    batch.seeds.clear();
+    if (!stages_.empty()) {
+        batch.seeds.resize(batch_size);
+        for (auto& seed: batch.seeds) {
+            seed = seed_generator_();
+        }
+    }
+}
+
+void DataProvider::load_batch(const vector<chunk_ptr>& chunks_in, const Batch& batch) const {
+    int batch_size = batch.samples.size();
+    if (!stages_.empty()) {
+        for (size_t i = 0; i < chunks_in.size(); ++i) {
+            load_stage(chunks_in[i], stages_[i], batch);
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < chunks_in.size(); ++i) {
         const chunk_ptr& chunk = chunks_in[i];
-        data_t& data = data_vec_[i];
+        const data_t& data = data_vec_[i];
         chunk->reshape(batch_size, chunk->channels(), chunk->height(), chunk->width());
 
         int dim = chunk->channels() * chunk->height() * chunk->width();
-        if (dim != data[0].size()) {
+        if (size_t(dim) != data[0].size()) {
             cout << "Input Chunk " << i+1 << " shape must match Input Data dim..." << endl;
             exit(1);
         }
 
         float* chunk_data = chunk->data();
-        for (int n = load_start; n < load_end; ++n) {
-            memcpy(chunk_data, data[n].data(), dim*sizeof(float));
+        for (int sample: batch.samples) {
+            memcpy(chunk_data, data[sample].data(), dim*sizeof(float));
             chunk_data += dim;
         }
     }
 }
 
+void DataProvider::load_stage(const chunk_ptr& chunk, const DataStage& stage, const Batch& batch) const {
+    const data_t& data = data_vec_[stage.source];
+    int batch_size = batch.samples.size();
+    chunk->reshape(batch_size, chunk->channels(), chunk->height(), chunk->width());
+
+    vector<vector<int>> shapes {stage.shape};
+    int max_dim = stage.shape[0] * stage.shape[1] * stage.shape[2];
+    for (const auto& transform: stage.transforms) {
+        shapes.push_back(transform->shape_inference(shapes.back()));
+        max_dim = max(max_dim, shapes.back()[0] * shapes.back()[1] * shapes.back()[2]);
+    }
+    int dim = chunk->channels() * chunk->height() * chunk->width();
+    if (dim != shapes.back()[0] * shapes.back()[1] * shapes.back()[2] ||
+        data[0].size() != size_t(stage.shape[0] * stage.shape[1] * stage.shape[2])) {
+        cout << "Input Chunk " << chunk->str_shape() << " shape must match transformed Data dim..." << endl;
+        exit(1);
+    }
+
+    float* chunk_data = chunk->data();
+    int num_transforms = stage.transforms.size();
+    auto worker = [&](int begin, int end) {
+        vector<float> ping(max_dim), pong(max_dim);
+        for (int n = begin; n < end; ++n) {
+            const float* in = data[batch.samples[n]].data();
+            for (int t = 0; t < num_transforms; ++t) {
+                float* out = t == num_transforms - 1? chunk_data + n * dim: (t % 2 == 0? ping.data(): pong.data());
+                stage.transforms[t]->apply(in, shapes[t], out, augment_, batch.seeds[n] + 7919u * t);
+                in = out;
+            }
+            if (num_transforms == 0) {
+                memcpy(chunk_data + n * dim, in, dim*sizeof(float));
+            }
+        }
+    };
+
+    if (num_transforms == 0) {
+        worker(0, batch_size);
+        return;
+    }
+    parallel_for(0, batch_size, worker);
+}
+
 void DataProvider::shuffle_data() {
     unsigned seed = chrono::system_clock::now().time_since_epoch().count();
-    for (auto& data: data_vec_) {
-        shuffle(data.begin(), data.end(), default_random_engine(seed));
-    }
+    shuffle(order_.begin(), order_.end(), default_random_engine(seed));
     cout << "Shuffle data done, load batch data from a new epoch..." << endl;
 }
 
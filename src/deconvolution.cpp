@@ -3,6 +3,7 @@
 #include "deconvolution.h"
 #include "util.h"
 #include "math_func.h"
+#include "threadpool.h"
 
 namespace micronet {
 
@@ -64,7 +65,6 @@ void Deconvolution::forward(bool is_train) {
 
     chunks_out_[0]->reshape(shape_inference());
 
-    col_tmp_->reshape(output_channels*kernel_h*kernel_w, input_h*input_w, 1, 1);
     all_one_tmp_->reshape(output_h, output_w, 1, 1);
     all_one_tmp_->fill_value(1.0, 1.0);
     //output[0]->reshape(shape_inference(input[0]));
@@ -75,44 +75,24 @@ void Deconvolution::forward(bool is_train) {
     float* output_data = chunks_out_[0]->data();
     memset(output_data, 0, chunks_out_[0]->count()*sizeof(float));
 
-    float img2col_time = 0, gemm_time = 0, bias_time = 0;
-    for (int n = 0; n < num; ++n) {
-        float* col_data = col_tmp_->data();
-        const float* all_one_data = all_one_tmp_->const_data();
-
-        //Timer timer;
-        //img2col(input_data, input_channels, input_h, input_w, kernel_h, kernel_w,
-        //        pad_h, pad_w, stride_h, stride_w, col_data);
-        //img2col_time += timer.elapsed()*1000;
-            //cout << "img2col time: " << timer.elapsed()*1000 << endl;
-
-        //timer.resume();
-        //gemm(0, 0, output_channels, output_h*output_w, input_channels*kernel_h*kernel_w, 1,
-        //     weights_data, input_channels*kernel_h*kernel_w, col_data, output_h*output_w, 0,
-        //     output_data, output_h*output_w);
-        gemm(1, 0, output_channels*kernel_h*kernel_w, input_h*input_w, input_channels, 1,
-             weights_data, output_channels*kernel_h*kernel_w, input_data, input_h*input_w, 0,
-             col_data, input_h*input_w);
-        col2img(col_data, output_channels, output_h, output_w, kernel_h, kernel_w, pad_h, pad_w,
-                stride_h, stride_w, output_data);
-        gemm(0, 0, output_channels, output_h*output_w, 1, 1,
-             bias_data, 1, all_one_data, output_h*output_w, 1,
-             output_data, output_h*output_w);
-        //gemm_time += timer.elapsed()*1000;
-            //cout << "gemm time: " << timer.elapsed()*1000 << endl;
-
-        //timer.resume();
-        /*float* output_data_tmp = output_data;
-        for (int c = 0; c < output_channels; ++c) {
-            add_scalar(output_h*output_w, bias_data[c], output_data_tmp);
-            output_data_tmp += output_h * output_w;
-        }*/
-        //bias_time += timer.elapsed()*1000;
-            //cout << "bias time: " << timer.elapsed()*1000 << endl;
-
-        input_data += input_channels * input_h * input_w;
-        output_data += output_channels * output_h * output_w;
-    }
+    const float* all_one_data = all_one_tmp_->const_data();
+    // batch level when there is a sample per thread, else the gemms get the threads
+    parallel_for(0, num, [&](int begin, int end) {
+        Chunk col_tmp(output_channels*kernel_h*kernel_w, input_h*input_w, 1, 1);
+        float* col_data = col_tmp.data();
+        for (int n = begin; n < end; ++n) {
+            const float* input_data_tmp = input_data + n * input_channels * input_h * input_w;
+            float* output_data_tmp = output_data + n * output_channels * output_h * output_w;
+            gemm(1, 0, output_channels*kernel_h*kernel_w, input_h*input_w, input_channels, 1,
+                 weights_data, output_channels*kernel_h*kernel_w, input_data_tmp, input_h*input_w, 0,
+                 col_data, input_h*input_w);
+            col2img(col_data, output_channels, output_h, output_w, kernel_h, kernel_w, pad_h, pad_w,
+                    stride_h, stride_w, output_data_tmp);
+            gemm(0, 0, output_channels, output_h*output_w, 1, 1,
+                 bias_data, 1, all_one_data, output_h*output_w, 1,
+                 output_data_tmp, output_h*output_w);
+        }
+    }, batch_parallel(num)? 1: num);
     //cout << "conv forward time:" << timer_for.elapsed()*1000 << endl;
     //exit(0);
     gradient_reset();
@@ -144,41 +124,50 @@ void Deconvolution::backward() {
     const float* weights_data = params_[0]->const_data();
     const float* output_diff = chunks_out_[0]->const_diff();
 
-    for (int n = 0; n < num; ++n) {
-        float* col_diff = col_tmp_->diff();
-        const float* all_one_data = all_one_tmp_->const_data();
-        img2col(output_diff, output_channels, output_h, output_w, kernel_h, kernel_w,
-                pad_h, pad_w, stride_h, stride_w, col_diff);
-
-        gemm(0, 1, input_channels, output_channels*kernel_h*kernel_w, input_h*input_w, 1,
-             input_data, input_h*input_w, col_diff, input_h*input_w, 1,
-             weights_diff, output_channels*kernel_h*kernel_w);
-        gemm(0, 0, input_channels, input_h*input_w, output_channels*kernel_h*kernel_w, 1,
-             weights_data, output_channels*kernel_h*kernel_w, col_diff, input_h*input_w, 1,
-             input_diff, input_h*input_w);
-
-        gemm(0, 1, output_channels, 1, output_h*output_w, 1,
-             output_diff, output_h*output_w, all_one_data, output_h*output_w, 1,
-             bias_diff, 1);
-
-        /*const float* output_diff_tmp = output_diff;
-        for (int c = 0; c < output_channels; ++c) {
-            bias_diff[c] = sum(output_h*output_w, bias_diff[c], output_diff_tmp);
-            output_diff_tmp += output_h * output_w;
-        }*/
-
-        input_data += input_channels * input_h * input_w;
-        input_diff += input_channels * input_h * input_w;
-        output_diff += output_channels * output_h * output_w;
+    // per sample param diffs when samples run concurrently, summed in sample
+    // order so both ways give the same result
+    bool per_sample = batch_parallel(num);
+    vector<Chunk> weights_tmp(per_sample? num: 0, Chunk(params_[0]->shape()));
+    vector<Chunk> bias_tmp(per_sample? num: 0, Chunk(params_[1]->shape()));
+    const float* all_one_data = all_one_tmp_->const_data();
+    parallel_for(0, num, [&](int begin, int end) {
+        Chunk col_tmp(output_channels*kernel_h*kernel_w, input_h*input_w, 1, 1);
+        float* col_diff = col_tmp.diff();
+        for (int n = begin; n < end; ++n) {
+            const float* input_data_tmp = input_data + n * input_channels * input_h * input_w;
+            float* input_diff_tmp = input_diff + n * input_channels * input_h * input_w;
+            const float* output_diff_tmp = output_diff + n * output_channels * output_h * output_w;
+            img2col(output_diff_tmp, output_channels, output_h, output_w, kernel_h, kernel_w,
+                    pad_h, pad_w, stride_h, stride_w, col_diff);
+
+            gemm(0, 1, input_channels, output_channels*kernel_h*kernel_w, input_h*input_w, 1,
+                 input_data_tmp, input_h*input_w, col_diff, input_h*input_w, 1,
+                 per_sample? weights_tmp[n].diff(): weights_diff, output_channels*kernel_h*kernel_w);
+            gemm(0, 0, input_channels, input_h*input_w, output_channels*kernel_h*kernel_w, 1,
+                 weights_data, output_channels*kernel_h*kernel_w, col_diff, input_h*input_w, 1,
+                 input_diff_tmp, input_h*input_w);
+            gemm(0, 1, output_channels, 1, output_h*output_w, 1,
+                 output_diff_tmp, output_h*output_w, all_one_data, output_h*output_w, 1,
+                 per_sample? bias_tmp[n].diff(): bias_diff, 1);
+        }
+    }, per_sample? 1: num);
+    for (const auto& chunk: weights_tmp) {
+        const float* diff = chunk.const_diff();
+        for (int i = 0; i < chunk.count(); ++i) {
+            weights_diff[i] += diff[i];
+        }
+    }
+    for (const auto& chunk: bias_tmp) {
+        const float* diff = chunk.const_diff();
+        for (int i = 0; i < chunk.count(); ++i) {
+            bias_diff[i] += diff[i];
+        }
     }
 }
 
 void Deconvolution::initialize() {
-    float* weights_data = params_[0]->data();
-    float* bias_data = params_[1]->data();
-
-    normal_random_init(params_[0]->count(), weights_data, flt_hps_["init_mean"], flt_hps_["init_stddev"]);
-    constant_init(params_[1]->count(), bias_data, flt_hps_["init_bias_value"]);
+    defer_init(0, "normal", flt_hps_["init_mean"], flt_hps_["init_stddev"]);
+    defer_init(1, "constant", flt_hps_["init_bias_value"]);
 }
 
 void Deconvolution::pad_inference() {
@@ -12,6 +12,7 @@
 #include "dense.h"
 #include "util.h"
 #include "math_func.h"
+#include "threadpool.h"
 
 namespace micronet {
 
@@ -58,8 +59,12 @@ void Dense::forward(bool is_train) {
     const float* bias_data = params_[1]->const_data();
     const float* all_one_data = all_one_tmp_.const_data();
     float* output_data = chunks_out_[0]->data();
-    gemm(0, 0, num, out_dim, in_dim, 1, input_data, in_dim, weight_data, out_dim, 0, output_data, out_dim);
-    gemm(0, 0, num, out_dim, 1, 1, all_one_data, 1, bias_data, out_dim, 1, output_data, out_dim);
+    if (num <= GEMV_MAX_BATCH) {
+        batched_gemv(num, out_dim, in_dim, input_data, weight_data, bias_data, output_data);
+    } else {
+        gemm(0, 0, num, out_dim, in_dim, 1, input_data, in_dim, weight_data, out_dim, 0, output_data, out_dim);
+        gemm(0, 0, num, out_dim, 1, 1, all_one_data, 1, bias_data, out_dim, 1, output_data, out_dim);
+    }
     /*for (int n = 0; n < num; ++n) {
         add(out_dim, output_data, 1, bias_data, 1, output_data);
         output_data += out_dim;
@@ -87,9 +92,12 @@ void Dense::backward() {
     const float* output_diff = chunks_out_[0]->const_diff();
     const float* all_one_data = all_one_tmp_.const_data();
     float* input_diff = chunks_in_[0]->diff();
+    TaskGroup tasks(ThreadPool::instance());
+    run_param_grads(tasks, [=] {
+        gemm(1, 0, in_dim, out_dim, num, 1, input_data, in_dim, output_diff, out_dim, 1, weights_diff, out_dim);
+        gemm(1, 0, 1, out_dim, num, 1, all_one_data, 1, output_diff, out_dim, 1, bias_diff, out_dim);
+    });
     gemm(0, 1, num, in_dim, out_dim, 1, output_diff, out_dim, weights_data, out_dim, 1, input_diff, in_dim);
-    gemm(1, 0, in_dim, out_dim, num, 1, input_data, in_dim, output_diff, out_dim, 1, weights_diff, out_dim);
-    gemm(1, 0, 1, out_dim, num, 1, all_one_data, 1, output_diff, out_dim, 1, bias_diff, out_dim);
     //cout << bias_diff[1] << endl;
     //exit(0);
     /*for (int n = 0; n < num; ++n) {
@@ -101,11 +109,8 @@ void Dense::backward() {
 }
 
 void Dense::initialize() {
-    float* weights_data = params_[0]->data();
-    float* bias_data = params_[1]->data();
-
-    normal_random_init(params_[0]->count(), weights_data, flt_hps_["init_mean"], flt_hps_["init_stddev"]);
-    constant_init(params_[1]->count(), bias_data, flt_hps_["init_bias_value"]);
+    defer_init(0, "normal", flt_hps_["init_mean"], flt_hps_["init_stddev"]);
+    defer_init(1, "constant", flt_hps_["init_bias_value"]);
 }
 
 vector<int> Dense::shape_inference() {
@@ -53,11 +53,13 @@ GanNet::GanNet(chunk_ptr (*generator_constructor)(const chunk_ptr&), int noise_d
 }
 
 void GanNet::fit(const map<string, data_t>& train_data, const map<string, data_t>& valid_data,
-                      int batch_size, int epochs, int verbose, bool shuffle) {
+                      int batch_size, int epochs, int verbose, bool shuffle,
+                      int accumulation_steps) {
     if (!net_initialized_) {
         cout << "net need to be initialized first!" << endl;
         exit(1);
     }
+    materialize_params();
     if (!optimizer_) {
         cout << "optimizer must be assigned!" << endl;
         exit(1);
@@ -78,8 +80,10 @@ void GanNet::fit(const map<string, data_t>& train_data, const map<string, data_t
     vector<data_t> real_data_vec {train_data.at("real")};
     DataProvider real_data(real_data_vec, true);
     int num_examples = real_data.num_samples();
-    int num_fit_iters = num_examples * epochs / batch_size;
-    int steps_per_epoch = num_examples / batch_size;
+    // every step accumulates accumulation_steps micro batches of batch_size
+    int step_size = batch_size * max(1, accumulation_steps);
+    int num_fit_iters = num_examples * epochs / step_size;
+    int steps_per_epoch = num_examples / step_size;
 
     optimizer_->total_iters_ = num_fit_iters;
 
@@ -104,17 +108,30 @@ void GanNet::fit(const map<string, data_t>& train_data, const map<string, data_t
             }
             real_data.load_batch({real}, batch_size);
             iter_++;
-            forward(true, "discriminator");
-            backward("discriminator");
+            accumulate(accumulation_steps, [&](int micro) {
+                if (micro > 0) {
+                    normal_random_init(noise->count(), noise->data(), 0.0f, 0.1f);
+                    uniform_random_init(noise_label->count(), noise_label->data(), 0.0f, 0.2f);
+                    uniform_random_init(real_label->count(), real_label->data(), 0.8f, 1.0f);
+                    real_data.load_batch({real}, batch_size);
+                }
+                forward(true, "discriminator");
+                backward("discriminator");
+            });
             update("discriminator");
 
             // optimizer generator
             real->reshape(0, real_shape[1], real_shape[2], real_shape[3]);
             real_label->reshape(0, 1, 1, 1);
             //constant_init(noise_label->count(), noise_label->data(), 1.0f);
-            uniform_random_init(noise_label->count(), noise_label->data(), 0.8f, 1.0f);
-            forward(true, "generator");
-            backward("generator");
+            accumulate(accumulation_steps, [&](int micro) {
+                if (micro > 0) {
+                    normal_random_init(noise->count(), noise->data(), 0.0f, 0.1f);
+                }
+                uniform_random_init(noise_label->count(), noise_label->data(), 0.8f, 1.0f);
+                forward(true, "generator");
+                backward("generator");
+            });
             update("generator");
 
             double time_used = step_timer.elapsed()*1000;
@@ -140,6 +157,7 @@ data_t GanNet::inference(const map<string, data_t>& data, int batch_size) {
         cout << "net need to be initialized first!" << endl;
         exit(1);
     }
+    materialize_params();
     if (data.find("noise") == data.end()) {
         cout << "noise data must be specified!" << endl;
         exit(1);
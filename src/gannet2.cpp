@@ -1,5 +1,6 @@
 
 #include <queue>
+#include <string.h>
 #include <set>
 #include "gannet2.h"
 #include "concatenate.h"
@@ -65,16 +66,18 @@ GanNet2::GanNet2(chunk_ptr (*generator_constructor)(const chunk_ptr&), int noise
 }
 
 void GanNet2::fit(const map<string, data_t>& train_data, const map<string, data_t>& valid_data,
-                      int batch_size, int epochs, int verbose, bool shuffle) {
+                      int batch_size, int epochs, int verbose, bool shuffle,
+                      int accumulation_steps) {
     if (!net_initialized_) {
         cout << "net need to be initialized first!" << endl;
         exit(1);
     }
+    materialize_params();
     if (!optimizer_) {
         cout << "optimizer must be assigned!" << endl;
         exit(1);
     }
-    if (train_data.find("real") == train_data.end()) {
+    if (!has_data(train_data, "real")) {
         cout << "train real data must be specified!" << endl;
         exit(1);
     }
@@ -89,11 +92,12 @@ void GanNet2::fit(const map<string, data_t>& train_data, const map<string, data_
     vector<int> noise_shape = noise->shape();
     vector<int> real_shape = real->shape();
 
-    vector<data_t> real_data_vec {train_data.at("real")};
-    DataProvider real_data(real_data_vec, true);
-    int num_examples = real_data.num_samples();
-    int num_fit_iters = num_examples * epochs / batch_size;
-    int steps_per_epoch = num_examples / batch_size;
+    auto real_data = make_provider(train_data, {"real"}, true, true);
+    int num_examples = real_data->num_samples();
+    // every step accumulates accumulation_steps micro batches of batch_size
+    int step_size = batch_size * max(1, accumulation_steps);
+    int num_fit_iters = num_examples * epochs / step_size;
+    int steps_per_epoch = num_examples / step_size;
 
     optimizer_->total_iters_ = num_fit_iters;
 
@@ -109,21 +113,35 @@ void GanNet2::fit(const map<string, data_t>& train_data, const map<string, data_
             real_label->reshape(batch_size, 1, 1, 1);
             normal_random_init(noise->count(), noise->data(), 0.0f, 0.1f);
             uniform_random_init(noise_label->count(), noise_label->data(), 0.0f, 0.2f);
-            real_data.load_batch({real}, batch_size);
+            real_data->load_batch({real}, batch_size);
             uniform_random_init(real_label->count(), real_label->data(), 0.8f, 1.0f);
             if (iter_ % 500 == 0) {
                 save_generator_imgs(iter_);
             }
             iter_++;
-            forward(true, "discriminator");
-            backward("discriminator");
+            accumulate(accumulation_steps, [&](int micro) {
+                if (micro > 0) {
+                    normal_random_init(noise->count(), noise->data(), 0.0f, 0.1f);
+                    uniform_random_init(noise_label->count(), noise_label->data(), 0.0f, 0.2f);
+                    real_data->load_batch({real}, batch_size);
+                    uniform_random_init(real_label->count(), real_label->data(), 0.8f, 1.0f);
+                }
+                forward(true, "discriminator");
+                backward("discriminator");
+            });
             update("discriminator");
 
             // optimizer generator
-            uniform_random_init(noise_label->count(), noise_label->data(), 0.8f, 1.0f);
-            forward(true, "generator");
-            backward("generator");
+            accumulate(accumulation_steps, [&](int micro) {
+                if (micro > 0) {
+                    normal_random_init(noise->count(), noise->data(), 0.0f, 0.1f);
+                }
+                uniform_random_init(noise_label->count(), noise_label->data(), 0.8f, 1.0f);
+                forward(true, "generator");
+                backward("generator");
+            });
             update("generator");
+            checkpoint_step();
 
             double time_used = step_timer.elapsed()*1000;
             if (iter % verbose == 0) {
@@ -150,36 +168,30 @@ data_t GanNet2::inference(const map<string, data_t>& data, int batch_size) {
         cout << "net need to be initialized first!" << endl;
         exit(1);
     }
+    materialize_params();
     if (data.find("noise") == data.end()) {
         cout << "noise data must be specified!" << endl;
         exit(1);
     }
 
     Timer timer;
-    vector<data_t> data_vec {data.at("noise")};
-    DataProvider infer(data_vec, false);
-    data_t data_inference;
-
-    int infer_steps = infer.num_samples() / batch_size;
-    int size_remain = infer.num_samples() % batch_size;
-    for (int step = 0; step < infer_steps; ++step) {
-        infer.load_batch({key_chunks_["noise"]}, batch_size);
-        forward_generator(false);
-        const float* generator_output_data = key_chunks_["generator_output"]->const_data();
-        int dim = key_chunks_["generator_output"]->count() / batch_size;
-        for (int i = 0; i < batch_size; ++i) {
-            data_inference.push_back(vector<float>(generator_output_data, generator_output_data+dim));
-            generator_output_data += dim;
+    auto infer = make_provider(data, {"noise"}, false, false);
+    auto generator_output = key_chunks_["generator_output"];
+    int dim = generator_output->channels() * generator_output->height() * generator_output->width();
+    data_t data_inference(infer->num_samples(), vector<float>(dim));
+
+    int infer_steps = infer->num_samples() / batch_size;
+    int size_remain = infer->num_samples() % batch_size;
+    for (int step = 0; step <= infer_steps; ++step) {
+        int step_size = step < infer_steps? batch_size: size_remain;
+        if (step_size == 0) {
+            break;
         }
-    }
-    if (size_remain) {
-        infer.load_batch({key_chunks_["noise"]}, size_remain);
-        forward_generator(false);
-        const float* generator_output_data = key_chunks_["generator_output"]->const_data();
-        int dim = key_chunks_["generator_output"]->count() / size_remain;
-        for (int i = 0; i < size_remain; ++i) {
-            data_inference.push_back(vector<float>(generator_output_data, generator_output_data+dim));
-            generator_output_data += dim;
+        infer->load_batch({key_chunks_["noise"]}, step_size);
+        forward_inference("generator_output");
+        const float* generator_output_data = generator_output->const_data();
+        for (int i = 0; i < step_size; ++i) {
+            memcpy(data_inference[step * batch_size + i].data(), generator_output_data + i * dim, dim*sizeof(float));
         }
     }
     cout << "inference time used: " << timer.elapsed() << " s" << endl;
@@ -187,23 +199,25 @@ data_t GanNet2::inference(const map<string, data_t>& data, int batch_size) {
     return data_inference;
 }
 
+inline bool starts_with(const string& str, const string& prefix) {
+    return str.find(prefix) == 0;
+}
+
 void GanNet2::forward(bool is_train, const string& layer_prefix) {
+    // the real and fake discriminator branches are independent and run concurrently
     if (layer_prefix == "discriminator") {
-        forward_generator(is_train);
-        forward_discriminator_real(is_train);
-        forward_discriminator_fake(is_train);
-        for (auto layer = net_sequences_.begin(); layer != net_sequences_.end(); ++layer) {
-            if ((*layer)->layer_name_ == "discriminator_loss_real" ||
-                (*layer)->layer_name_ == "discriminator_loss_fake" ||
-                (*layer)->layer_name_ == "discriminator_loss")
-                (*layer)->forward(is_train);
-        }
+        execute_forward(is_train, [](const layer_ptr& layer) {
+            const string& name = layer->layer_name_;
+            return (starts_with(name, "generator") && name != "generator_loss") ||
+                   starts_with(name, "discriminator_real") || starts_with(name, "discriminator_fake") ||
+                   name == "discriminator_loss_real" || name == "discriminator_loss_fake" ||
+                   name == "discriminator_loss";
+        });
     } else if (layer_prefix == "generator") {
-        forward_discriminator_fake(is_train);
-        for (auto layer = net_sequences_.begin(); layer != net_sequences_.end(); ++layer) {
-            if ((*layer)->layer_name_ == "generator_loss")
-                (*layer)->forward(is_train);
-        }
+        execute_forward(is_train, [](const layer_ptr& layer) {
+            return starts_with(layer->layer_name_, "discriminator_fake") ||
+                   layer->layer_name_ == "generator_loss";
+        });
     }
 
     //if (iter_ % 100 == 0) {
@@ -211,30 +225,24 @@ void GanNet2::forward(bool is_train, const string& layer_prefix) {
     //}
 }
 
-inline bool starts_with(const string& str, const string& prefix) {
-    return str.find(prefix) == 0;
-}
-
 void GanNet2::backward(const string& layer_prefix) {
     //Timer t1;
     if (layer_prefix == "discriminator") {
         float* discriminator_loss_diff = key_chunks_["discriminator_loss"]->diff();
         discriminator_loss_diff[0] = 1;
-        for (auto layer = net_sequences_.rbegin(); layer != net_sequences_.rend(); ++layer) {
-            if (starts_with((*layer)->layer_name_, "discriminator"))
-                (*layer)->backward();
-        }
+        execute_backward([](const layer_ptr& layer) {
+            return starts_with(layer->layer_name_, "discriminator");
+        });
     } else if (layer_prefix == "generator") {
         float* generator_loss_diff = key_chunks_["generator_loss"]->diff();
         generator_loss_diff[0] = 1;
         auto generator_output = key_chunks_["generator_output"];
         float* generator_output_diff = generator_output->diff();
         constant_init(generator_output->count(), generator_output_diff, 0);
-        for (auto layer = net_sequences_.rbegin(); layer != net_sequences_.rend(); ++layer) {
-            if (starts_with((*layer)->layer_name_, "generator") ||
-                starts_with((*layer)->layer_name_, "discriminator_fake"))
-                (*layer)->backward();
-        }
+        execute_backward([](const layer_ptr& layer) {
+            return starts_with(layer->layer_name_, "generator") ||
+                   starts_with(layer->layer_name_, "discriminator_fake");
+        });
     }
     //if (iter_ % 100 == 0) {
     //    cout << "backward: " << t1.elapsed()*1000 << endl;
@@ -271,28 +279,21 @@ void GanNet2::update(const string& layer_prefix) {
 }
 
 void GanNet2::forward_generator(bool is_train) {
-    for (auto layer = net_sequences_.begin(); layer != net_sequences_.end(); ++layer) {
-        if (starts_with((*layer)->layer_name_, "generator")
-            && (*layer)->layer_name_ != "generator_loss") {
-            (*layer)->forward(is_train);
-        }
-    }
+    execute_forward(is_train, [](const layer_ptr& layer) {
+        return starts_with(layer->layer_name_, "generator") && layer->layer_name_ != "generator_loss";
+    });
 }
 
 void GanNet2::forward_discriminator_real(bool is_train) {
-    for (auto layer = net_sequences_.begin(); layer != net_sequences_.end(); ++layer) {
-        if (starts_with((*layer)->layer_name_, "discriminator_real")) {
-            (*layer)->forward(is_train);
-        }
-    }
+    execute_forward(is_train, [](const layer_ptr& layer) {
+        return starts_with(layer->layer_name_, "discriminator_real");
+    });
 }
 
 void GanNet2::forward_discriminator_fake(bool is_train) {
-    for (auto layer = net_sequences_.begin(); layer != net_sequences_.end(); ++layer) {
-        if (starts_with((*layer)->layer_name_, "discriminator_fake")) {
-            (*layer)->forward(is_train);
-        }
-    }
+    execute_forward(is_train, [](const layer_ptr& layer) {
+        return starts_with(layer->layer_name_, "discriminator_fake");
+    });
 }
 
 void GanNet2::save_generator_imgs(int iter) {
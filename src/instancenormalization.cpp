@@ -1,8 +1,8 @@
 #include <cstring>
-#include "omp.h"
 #include "instancenormalization.h"
 #include "math_func.h"
 #include "util.h"
+#include "threadpool.h"
 
 namespace micronet {
 
@@ -52,10 +52,12 @@ void InstanceNormalization::forward(bool is_train) {
     float* mean_data = mean_->data();
     float* var_data = var_->data();
 
+    const int num = in_chunk->num();
+    const int channels = in_chunk->channels();
     const int m = in_chunk->height() * in_chunk->width();
-    #pragma omp parallel for
-    for (int n = 0; n < in_chunk->num(); ++n) {
-        for (int c = 0; c < in_chunk->channels(); ++c) {
+    parallel_for(0, num * channels, [&](int begin, int end) {
+        for (int nc = begin; nc < end; ++nc) {
+            const int n = nc / channels, c = nc % channels;
             const int mindex = mean_->offset(n, c, 0, 0);
             mean_data[mindex] = 0;
             for (int h = 0; h < in_chunk->height(); ++h) {
@@ -66,10 +68,10 @@ void InstanceNormalization::forward(bool is_train) {
             }
             mean_data[mindex] /= m;
         }
-    }
-    #pragma omp parallel for
-    for (int n = 0; n < in_chunk->num(); ++n) {
-        for (int c = 0; c < in_chunk->channels(); ++c) {
+    }, plane_grain(m));
+    parallel_for(0, num * channels, [&](int begin, int end) {
+        for (int nc = begin; nc < end; ++nc) {
+            const int n = nc / channels, c = nc % channels;
             const int vindex = var_->offset(n, c, 0, 0);
             var_data[vindex] = 0;
             for (int h = 0; h < in_chunk->height(); ++h) {
@@ -80,11 +82,11 @@ void InstanceNormalization::forward(bool is_train) {
             }
             var_data[vindex] /= m;
         }
-    }
+    }, plane_grain(m));
 
-    #pragma omp parallel for
-    for (int n = 0; n < in_chunk->num(); ++n) {
-        for (int c = 0; c < in_chunk->channels(); ++c) {
+    parallel_for(0, num * channels, [&](int begin, int end) {
+        for (int nc = begin; nc < end; ++nc) {
+            const int n = nc / channels, c = nc % channels;
             const int mindex = mean_->offset(n, c, 0, 0);
             for (int h = 0; h < in_chunk->height(); ++h) {
                 for (int w = 0; w < in_chunk->width(); ++w) {
@@ -95,7 +97,7 @@ void InstanceNormalization::forward(bool is_train) {
                 }
             }
         }
-    }
+    }, plane_grain(m));
 
     gradient_reset();
 }
@@ -119,10 +121,12 @@ void InstanceNormalization::backward() {
     float* gamma_diff = gamma->diff();
     float* beta_diff = beta->diff();
 
+    const int num = in_chunk->num();
+    const int channels = in_chunk->channels();
     const int m = in_chunk->height() * in_chunk->width();
-    #pragma omp parallel for
-    for (int n = 0; n < in_chunk->num(); ++n) {
-        for (int c = 0; c < in_chunk->channels(); ++c) {
+    parallel_for(0, num * channels, [&](int begin, int end) {
+        for (int nc = begin; nc < end; ++nc) {
+            const int n = nc / channels, c = nc % channels;
             const int mindex = mean_->offset(n, c, 0, 0);
             mean_diff[mindex] = 0;
             var_diff[mindex] = 0;
@@ -139,23 +143,26 @@ void InstanceNormalization::backward() {
             }
             mean_diff[mindex] += var_diff[mindex] * tmp / m;
         }
-    }
-
-    for (int n = 0; n < in_chunk->num(); ++n) {
-        for (int c = 0; c < in_chunk->channels(); ++c) {
-            for (int h = 0; h < in_chunk->height(); ++h) {
-                for (int w = 0; w < in_chunk->width(); ++w) {
-                    const int oindex = out_chunk->offset(n, c, h, w);
-                    gamma_diff[c] += out_diff[oindex] * out_no_shift_data[oindex];
-                    beta_diff[c] += out_diff[oindex];
+    }, plane_grain(m));
+
+    // split by channel, samples summed in order
+    parallel_for(0, channels, [&](int begin, int end) {
+        for (int c = begin; c < end; ++c) {
+            for (int n = 0; n < num; ++n) {
+                for (int h = 0; h < in_chunk->height(); ++h) {
+                    for (int w = 0; w < in_chunk->width(); ++w) {
+                        const int oindex = out_chunk->offset(n, c, h, w);
+                        gamma_diff[c] += out_diff[oindex] * out_no_shift_data[oindex];
+                        beta_diff[c] += out_diff[oindex];
+                    }
                 }
             }
         }
-    }
+    }, plane_grain(num * m));
 
-    #pragma omp parallel for
-    for (int n = 0; n < in_chunk->num(); ++n) {
-        for (int c = 0; c < in_chunk->channels(); ++c) {
+    parallel_for(0, num * channels, [&](int begin, int end) {
+        for (int nc = begin; nc < end; ++nc) {
+            const int n = nc / channels, c = nc % channels;
             const int mindex = mean_->offset(n, c, 0, 0);
             for (int h = 0; h < in_chunk->height(); ++h) {
                 for (int w = 0; w < in_chunk->width(); ++w) {
@@ -166,14 +173,12 @@ void InstanceNormalization::backward() {
                 }
             }
         }
-    }
+    }, plane_grain(m));
 }
 
 void InstanceNormalization::initialize() {
-    float* gamma_data = params_[0]->data();
-    float* beta_data = params_[1]->data();
-    normal_random_init(params_[0]->count(), gamma_data, 0.0f, 0.1f);
-    constant_init(params_[1]->count(), beta_data, 0.1f);
+    defer_init(0, "normal", 0.0f, 0.1f);
+    defer_init(1, "constant", 0.1f);
 }
 
 vector<int> InstanceNormalization::shape_inference() {
@@ -0,0 +1,249 @@
+/**
+ * @file jsonmodel.cpp
+ * @auther yefajie
+ * @data 2026/10/19
+ **/
+#include <math.h>
+#include <string.h>
+#include <fstream>
+#include <iostream>
+
+#include "jsonmodel.h"
+#include "allocator.h"
+
+namespace micronet {
+
+static const size_t ARENA_ALIGNMENT = BLOB_ALIGNMENT / sizeof(float);
+
+// Aligned float buffer the param data is parsed into, chunks share it through
+// BlobSource::holder. Grows geometrically in whole ARENA_ALIGNMENT blocks.
+class FloatArena {
+public:
+    explicit FloatArena(size_t capacity): data_(nullptr), size_(0), capacity_(0) {
+        reserve(capacity);
+    }
+    ~FloatArena() {
+        free_floats(data_);
+    }
+    FloatArena(const FloatArena&) = delete;
+    FloatArena& operator=(const FloatArena&) = delete;
+
+    const float* data() const {return data_;};
+    size_t size() const {return size_;};
+
+    void push_back(float value) {
+        if (size_ == capacity_) {
+            reserve(2 * capacity_);
+        }
+        data_[size_++] = value;
+    }
+    void align() {
+        size_t aligned = (size_ + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT * ARENA_ALIGNMENT;
+        reserve(aligned);
+        fill(data_ + size_, data_ + aligned, 0.0f);
+        size_ = aligned;
+    }
+
+private:
+    void reserve(size_t capacity) {
+        capacity = max((capacity + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT * ARENA_ALIGNMENT, ARENA_ALIGNMENT);
+        if (capacity <= capacity_) {
+            return;
+        }
+        float* data = allocate_floats(capacity);
+        if (size_ > 0) {
+            memcpy(data, data_, size_ * sizeof(float));
+        }
+        free_floats(data_);
+        data_ = data;
+        capacity_ = capacity;
+    }
+
+    float* data_;
+    size_t size_;
+    size_t capacity_;
+};
+
+class ModelSaxHandler {
+public:
+    using number_integer_t = json::number_integer_t;
+    using number_unsigned_t = json::number_unsigned_t;
+    using number_float_t = json::number_float_t;
+    using string_t = json::string_t;
+
+    ModelSaxHandler(json& j_net, FloatArena& arena): dom_(j_net, false), arena_(arena),
+        data_key_(false), in_data_(false), data_begin_(0), data_count_(0), shape_count_(0),
+        has_data_(false), has_shape_(false) {};
+
+    bool null() {
+        if (in_data_) {
+            arena_.push_back(NAN);
+            return true;
+        }
+        return dom_.null();
+    }
+    bool boolean(bool value) {
+        if (in_data_) {
+            return reject_data("a boolean");
+        }
+        return dom_.boolean(value);
+    }
+    bool number_integer(number_integer_t value) {
+        if (in_data_) {
+            arena_.push_back(float(value));
+            return true;
+        }
+        if (in_shape()) {
+            shape_count_ *= size_t(max(value, number_integer_t(0)));
+        }
+        return dom_.number_integer(value);
+    }
+    bool number_unsigned(number_unsigned_t value) {
+        if (in_data_) {
+            arena_.push_back(float(value));
+            return true;
+        }
+        if (in_shape()) {
+            shape_count_ *= size_t(value);
+        }
+        return dom_.number_unsigned(value);
+    }
+    bool number_float(number_float_t value, const string_t& text) {
+        if (in_data_) {
+            arena_.push_back(float(value));
+            return true;
+        }
+        return dom_.number_float(value, text);
+    }
+    bool string(string_t& value) {
+        if (in_data_) {
+            return reject_data("a string");
+        }
+        return dom_.string(value);
+    }
+    bool start_object(size_t elements) {
+        if (in_data_) {
+            return reject_data("an object");
+        }
+        open_scope(false);
+        if (in_param(scopes_.size())) {
+            has_data_ = false;
+            has_shape_ = false;
+        }
+        return dom_.start_object(elements);
+    }
+    bool end_object() {
+        if (in_param(scopes_.size()) && has_data_ && has_shape_ && data_count_ != shape_count_) {
+            cout << "param has " << data_count_ << " values, its shape needs " << shape_count_ << "!" << endl;
+            return false;
+        }
+        scopes_.pop_back();
+        return dom_.end_object();
+    }
+    bool key(string_t& value) {
+        if (value == "data" && in_param(scopes_.size())) {
+            data_key_ = true;
+            return true;
+        }
+        key_ = value;
+        return dom_.key(value);
+    }
+    bool start_array(size_t elements) {
+        if (in_data_) {
+            return reject_data("a nested array");
+        }
+        if (data_key_) {
+            data_key_ = false;
+            in_data_ = true;
+            arena_.align();
+            data_begin_ = arena_.size();
+            return true;
+        }
+        if (key_ == "shape" && in_param(scopes_.size())) {
+            has_shape_ = true;
+            shape_count_ = 1;
+        }
+        open_scope(true);
+        return dom_.start_array(elements);
+    }
+    bool end_array() {
+        if (in_data_) {
+            in_data_ = false;
+            has_data_ = true;
+            data_count_ = arena_.size() - data_begin_;
+            string_t offset = "offset", dtype = "dtype", fp32 = "fp32";
+            return dom_.key(offset) && dom_.number_unsigned(data_begin_ * sizeof(float)) &&
+                   dom_.key(dtype) && dom_.string(fp32);
+        }
+        scopes_.pop_back();
+        return dom_.end_array();
+    }
+    bool parse_error(size_t position, const std::string& last_token, const nlohmann::detail::exception& ex) {
+        return dom_.parse_error(position, last_token, ex);
+    }
+
+private:
+    // the values of a param's data go to the arena, the DOM parser is inside
+    // the param object and would take anything else as a key
+    bool reject_data(const char* what) {
+        cout << "param data must be a flat array of numbers, found " << what << "!" << endl;
+        return false;
+    }
+
+    // param objects are the elements of a layer's "params" array, depth counts
+    // the scopes up to and including the one checked
+    bool in_param(size_t depth) const {
+        return depth >= 2 && scopes_[depth - 1].first.empty() &&
+               scopes_[depth - 2].first == "params" && scopes_[depth - 2].second;
+    }
+    bool in_shape() const {
+        size_t depth = scopes_.size();
+        return depth >= 1 && scopes_[depth - 1].first == "shape" && scopes_[depth - 1].second &&
+               in_param(depth - 1);
+    }
+
+    // scopes hold the key a container was opened under, empty for array elements
+    void open_scope(bool is_array) {
+        bool element = !scopes_.empty() && scopes_.back().second;
+        scopes_.push_back(make_pair(element? string_t(): key_, is_array));
+    }
+
+    nlohmann::detail::json_sax_dom_parser<json> dom_;
+    FloatArena& arena_;
+    vector<pair<string_t, bool>> scopes_;
+    string_t key_;
+    bool data_key_;
+    bool in_data_;
+    size_t data_begin_;
+    size_t data_count_;
+    size_t shape_count_;
+    bool has_data_;
+    bool has_shape_;
+};
+
+json read_json_model(const string& save_path, BlobSource& blobs) {
+    std::ifstream ifs(save_path);
+    if (!ifs) {
+        cout << "can not open model file: " << save_path << endl;
+        exit(1);
+    }
+    // a value takes at least a few characters of text, so an arena as many
+    // bytes as the file rarely has to grow
+    ifs.seekg(0, std::ios::end);
+    size_t file_size = size_t(max(std::streamoff(ifs.tellg()), std::streamoff(0)));
+    ifs.seekg(0, std::ios::beg);
+    auto arena = make_shared<FloatArena>(file_size / 4);
+    json j_net;
+    ModelSaxHandler handler(j_net, *arena);
+    if (!json::sax_parse(ifs, &handler)) {
+        cout << "parse model file " << save_path << " failed!" << endl;
+        exit(1);
+    }
+
+    blobs.base = reinterpret_cast<const char*>(arena->data());
+    blobs.holder = arena;
+    blobs.size = arena->size() * sizeof(float);
+    return j_net;
+}
+
+} // namespace micronet
@@ -0,0 +1,89 @@
+/**
+ * @file lamboptimizer.cpp
+ * @auther yefajie
+ * @data 2026/10/19
+ **/
+#include <cmath>
+#include "lamboptimizer.h"
+
+namespace micronet {
+
+LAMBOptimizer::LAMBOptimizer(float learning_rate, vector<float> decay_locs, float decay_rate_1,
+                             float decay_rate_2, float weight_decay):
+    Optimizer("LAMB", decay_locs) {
+    flt_hps_["learning_rate"] = learning_rate;
+    flt_hps_["decay_rate_1"] = decay_rate_1;
+    flt_hps_["decay_rate_2"] = decay_rate_2;
+    flt_hps_["decay_rate_1_pow"] = 1;
+    flt_hps_["decay_rate_2_pow"] = 1;
+    flt_hps_["weight_decay"] = weight_decay;
+    int_hps_["iter"] = 0;
+}
+
+void LAMBOptimizer::prepare(const shared_ptr<Chunk>& param) {
+    state(first_moment_estimate_, param);
+    state(second_moment_estimate_, param);
+}
+
+void LAMBOptimizer::begin_iter(int iter) {
+    if (iter != int_hps_["iter"]) {
+        int_hps_["iter"] = iter;
+        flt_hps_["decay_rate_1_pow"] *= flt_hps_["decay_rate_1"];
+        flt_hps_["decay_rate_2_pow"] *= flt_hps_["decay_rate_2"];
+    }
+}
+
+LAMBOptimizer::StepHps LAMBOptimizer::resolve(int iter) {
+    begin_iter(iter);
+    StepHps hps = {decayed_learning_rate(iter), flt_hps_.at("decay_rate_1"), flt_hps_.at("decay_rate_2")};
+    hps.weight_decay = flt_hps_.at("weight_decay");
+    hps.correction_1 = 1 / (1 - flt_hps_.at("decay_rate_1_pow"));
+    hps.correction_2 = 1 / (1 - flt_hps_.at("decay_rate_2_pow"));
+    return hps;
+}
+
+LAMBOptimizer::StepBuffers LAMBOptimizer::buffers(const shared_ptr<Chunk>& param) {
+    return {param->data(), param->const_diff(),
+            {state(first_moment_estimate_, param).data(), state(second_moment_estimate_, param).data()}};
+}
+
+// the norm pass also advances the moments, update() then only recomputes the
+// direction from them
+void LAMBOptimizer::accumulate_norms(const StepHps& hps, const StepBuffers& buffers, int begin, int end,
+                                     double& weight_norm, double& update_norm) {
+    float decay_rate_1 = hps.rate_1;
+    float decay_rate_2 = hps.rate_2;
+    const float* diff = buffers.diff;
+    const float* data = buffers.data;
+    float* first_moment_est = buffers.state[0];
+    float* second_moment_est = buffers.state[1];
+    for (int i = begin; i < end; ++i) {
+        first_moment_est[i] = decay_rate_1 * first_moment_est[i] + (1 - decay_rate_1) * diff[i];
+        second_moment_est[i] = decay_rate_2 * second_moment_est[i] + (1 - decay_rate_2) * diff[i] * diff[i];
+        float direction = first_moment_est[i] * hps.correction_1 /
+                          (std::sqrt(second_moment_est[i] * hps.correction_2) + 1e-6f) + hps.weight_decay * data[i];
+        weight_norm += double(data[i]) * data[i];
+        update_norm += double(direction) * direction;
+    }
+}
+
+float LAMBOptimizer::trust_ratio(const StepHps& hps, double weight_norm, double update_norm) {
+    if (weight_norm <= 0 || update_norm <= 0) {
+        return 1;
+    }
+    return float(weight_norm / update_norm);
+}
+
+void LAMBOptimizer::update(const StepHps& hps, const StepBuffers& buffers, int begin, int end) {
+    float local_rate = hps.learning_rate * buffers.trust_ratio;
+    const float* first_moment_est = buffers.state[0];
+    const float* second_moment_est = buffers.state[1];
+    float* data = buffers.data;
+    for (int i = begin; i < end; ++i) {
+        float direction = first_moment_est[i] * hps.correction_1 /
+                          (std::sqrt(second_moment_est[i] * hps.correction_2) + 1e-6f) + hps.weight_decay * data[i];
+        data[i] -= local_rate * direction;
+    }
+}
+
+} // namespace micronet
@@ -0,0 +1,65 @@
+/**
+ * @file larsoptimizer.cpp
+ * @auther yefajie
+ * @data 2026/10/19
+ **/
+#include <cmath>
+#include "larsoptimizer.h"
+
+namespace micronet {
+
+LARSOptimizer::LARSOptimizer(float learning_rate, vector<float> decay_locs, float momentum,
+                             float weight_decay, float trust_coefficient):
+    Optimizer("LARS", decay_locs) {
+    flt_hps_["learning_rate"] = learning_rate;
+    flt_hps_["momentum"] = momentum;
+    flt_hps_["weight_decay"] = weight_decay;
+    flt_hps_["trust_coefficient"] = trust_coefficient;
+}
+
+void LARSOptimizer::prepare(const shared_ptr<Chunk>& param) {
+    state(param_velocity_, param);
+}
+
+LARSOptimizer::StepHps LARSOptimizer::resolve(int iter) {
+    StepHps hps = {decayed_learning_rate(iter), flt_hps_.at("momentum"), 0};
+    hps.weight_decay = flt_hps_.at("weight_decay");
+    hps.trust_coefficient = flt_hps_.at("trust_coefficient");
+    return hps;
+}
+
+LARSOptimizer::StepBuffers LARSOptimizer::buffers(const shared_ptr<Chunk>& param) {
+    return {param->data(), param->const_diff(), {state(param_velocity_, param).data(), nullptr}};
+}
+
+void LARSOptimizer::accumulate_norms(const StepHps& hps, const StepBuffers& buffers, int begin, int end,
+                                     double& weight_norm, double& update_norm) {
+    const float* data = buffers.data;
+    const float* diff = buffers.diff;
+    for (int i = begin; i < end; ++i) {
+        weight_norm += double(data[i]) * data[i];
+        update_norm += double(diff[i]) * diff[i];
+    }
+}
+
+float LARSOptimizer::trust_ratio(const StepHps& hps, double weight_norm, double update_norm) {
+    if (weight_norm <= 0 || update_norm <= 0) {
+        return 1;
+    }
+    return float(hps.trust_coefficient * weight_norm / (update_norm + hps.weight_decay * weight_norm));
+}
+
+void LARSOptimizer::update(const StepHps& hps, const StepBuffers& buffers, int begin, int end) {
+    float local_rate = hps.learning_rate * buffers.trust_ratio;
+    float momentum = hps.rate_1;
+    float weight_decay = hps.weight_decay;
+    const float* diff = buffers.diff;
+    float* data = buffers.data;
+    float* velocity = buffers.state[0];
+    for (int i = begin; i < end; ++i) {
+        velocity[i] = momentum * velocity[i] + local_rate * (diff[i] + weight_decay * data[i]);
+        data[i] -= velocity[i];
+    }
+}
+
+} // namespace micronet
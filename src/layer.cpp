@@ -6,6 +6,8 @@
  #include <string.h>
 
 #include "layer.h"
+#include "util.h"
+#include "threadpool.h"
 
 namespace micronet {
 
@@ -18,10 +20,32 @@ void Layer::gradient_reset() {
         float* diff = chunk->diff();
         memset(diff, 0, chunk->count()*sizeof(float));
     }
+    // packed param diffs are reset by the net in one pass
     for (chunk_ptr& param: params_) {
+        if (!param->owns_diff()) {
+            continue;
+        }
         float* diff = param->diff();
         memset(diff, 0, param->count()*sizeof(float));
     }
 }
 
+void Layer::defer_init(int index, const string& init_type, float value1, float value2) {
+    int seed = init_type == "normal"? next_seed(): 0;
+    param_inits_.push_back({params_[index], init_type, value1, value2, seed});
+}
+
+void Layer::run_param_grads(TaskGroup& tasks, function<void()> task) {
+    int num_threads = ExecContext::current_threads();
+    function<void()> in_context = [num_threads, task] {
+        ExecContext context(num_threads);
+        task();
+    };
+    if (collect_param_grads_) {
+        param_grads_.push_back(in_context);
+    } else {
+        tasks.run(in_context);
+    }
+}
+
 } // namespace micronet
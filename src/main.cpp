@@ -13,7 +13,6 @@
 #include <thread>
 #include <chrono>
 #include <string.h>
-#include <omp.h>
 
 #include "micronet.h"
 
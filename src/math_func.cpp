@@ -3,12 +3,12 @@
 #include <thread>
 #include <cmath>
 #include <vector>
-#include <omp.h>
+#include <cstring>
+#include <algorithm>
 #include <Eigen/Dense>
 
 #include "util.h"
-
-#define NUM_THREADS 4
+#include "threadpool.h"
 
 using namespace std;
 using namespace Eigen;
@@ -20,16 +20,16 @@ void gemm_nn(int M, int N, int K, float ALPHA,
         const float *B, int ldb,
         float *C, int ldc)
 {
-    int i,j,k;
-    #pragma omp parallel for
-    for(i = 0; i < M; ++i){
-        for(k = 0; k < K; ++k){
-            register float A_PART = ALPHA*A[i*lda+k];
-            for(j = 0; j < N; ++j){
-                C[i*ldc+j] += A_PART*B[k*ldb+j];
+    parallel_for(0, M, [&](int begin, int end) {
+        for(int i = begin; i < end; ++i){
+            for(int k = 0; k < K; ++k){
+                register float A_PART = ALPHA*A[i*lda+k];
+                for(int j = 0; j < N; ++j){
+                    C[i*ldc+j] += A_PART*B[k*ldb+j];
+                }
             }
         }
-    }
+    });
 }
 
 void gemm_nt(int M, int N, int K, float ALPHA,
@@ -37,17 +37,17 @@ void gemm_nt(int M, int N, int K, float ALPHA,
         const float *B, int ldb,
         float *C, int ldc)
 {
-    int i,j,k;
-    #pragma omp parallel for
-    for(i = 0; i < M; ++i){
-        for(j = 0; j < N; ++j){
-            register float sum = 0;
-            for(k = 0; k < K; ++k){
-                sum += ALPHA*A[i*lda+k]*B[j*ldb + k];
+    parallel_for(0, M, [&](int begin, int end) {
+        for(int i = begin; i < end; ++i){
+            for(int j = 0; j < N; ++j){
+                register float sum = 0;
+                for(int k = 0; k < K; ++k){
+                    sum += ALPHA*A[i*lda+k]*B[j*ldb + k];
+                }
+                C[i*ldc+j] += sum;
             }
-            C[i*ldc+j] += sum;
         }
-    }
+    });
 }
 
 void gemm_tn(int M, int N, int K, float ALPHA,
@@ -55,16 +55,16 @@ void gemm_tn(int M, int N, int K, float ALPHA,
         const float *B, int ldb,
         float *C, int ldc)
 {
-    int i,j,k;
-    #pragma omp parallel for
-    for(i = 0; i < M; ++i){
-        for(k = 0; k < K; ++k){
-            register float A_PART = ALPHA*A[k*lda+i];
-            for(j = 0; j < N; ++j){
-                C[i*ldc+j] += A_PART*B[k*ldb+j];
+    parallel_for(0, M, [&](int begin, int end) {
+        for(int i = begin; i < end; ++i){
+            for(int k = 0; k < K; ++k){
+                register float A_PART = ALPHA*A[k*lda+i];
+                for(int j = 0; j < N; ++j){
+                    C[i*ldc+j] += A_PART*B[k*ldb+j];
+                }
             }
         }
-    }
+    });
 }
 
 void gemm_tt(int M, int N, int K, float ALPHA,
@@ -72,17 +72,17 @@ void gemm_tt(int M, int N, int K, float ALPHA,
         const float *B, int ldb,
         float *C, int ldc)
 {
-    int i,j,k;
-    #pragma omp parallel for
-    for(i = 0; i < M; ++i){
-        for(j = 0; j < N; ++j){
-            register float sum = 0;
-            for(k = 0; k < K; ++k){
-                sum += ALPHA*A[i+k*lda]*B[k+j*ldb];
+    parallel_for(0, M, [&](int begin, int end) {
+        for(int i = begin; i < end; ++i){
+            for(int j = 0; j < N; ++j){
+                register float sum = 0;
+                for(int k = 0; k < K; ++k){
+                    sum += ALPHA*A[i+k*lda]*B[k+j*ldb];
+                }
+                C[i*ldc+j] += sum;
             }
-            C[i*ldc+j] += sum;
         }
-    }
+    });
 }
 
 void matmul_nn(int M, int N, int K, float ALPHA,
@@ -199,31 +199,65 @@ float sdot_sse(int n, const float *x, const float *y)
 #endif // __SSE__
 
 void mat_mul3(int n_a_rows, int n_a_cols, const float* a, int n_b_cols, const float* b, float* c, float alpha) {
-    int i, j, n_b_rows = n_a_cols;
+    int n_b_rows = n_a_cols;
     float* bT = mat_transpose(n_b_rows, n_b_cols, b);
-    for (i = 0; i < n_a_rows; ++i)
-		for (j = 0; j < n_b_cols; ++j)
-			c[i*n_b_cols+j] += alpha * sdot_8(n_a_cols, a+i*n_a_cols, bT+j*n_b_rows);
+    parallel_for(0, n_a_rows, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i)
+            for (int j = 0; j < n_b_cols; ++j)
+                c[i*n_b_cols+j] += alpha * sdot_8(n_a_cols, a+i*n_a_cols, bT+j*n_b_rows);
+    });
     delete[] bT;
 }
 
 #ifdef __SSE__
 void mat_mul4(int n_a_rows, int n_a_cols, const float* a, int n_b_cols, const float* b, float* c, float alpha) {
-    int i, j, ii, jj, x = 16, n_b_rows = n_a_cols;
+    int x = 16, n_b_rows = n_a_cols;
 	float* bT = mat_transpose(n_b_rows, n_b_cols, b);
-	for (i = 0; i < n_a_rows; i += x) {
-		for (j = 0; j < n_b_cols; j += x) {
-			int je = n_b_cols < j + x? n_b_cols : j + x;
-			int ie = n_a_rows < i + x? n_a_rows : i + x;
-			for (ii = i; ii < ie; ++ii)
-				for (jj = j; jj < je; ++jj)
-					c[ii*n_b_cols+jj] += alpha * sdot_sse(n_a_cols, a+ii*n_a_cols, bT+jj*n_b_rows);
+	parallel_for(0, (n_a_rows + x - 1) / x, [&](int begin, int end) {
+		for (int i = begin * x; i < end * x && i < n_a_rows; i += x) {
+			for (int j = 0; j < n_b_cols; j += x) {
+				int je = n_b_cols < j + x? n_b_cols : j + x;
+				int ie = n_a_rows < i + x? n_a_rows : i + x;
+				for (int ii = i; ii < ie; ++ii)
+					for (int jj = j; jj < je; ++jj)
+						c[ii*n_b_cols+jj] += alpha * sdot_sse(n_a_cols, a+ii*n_a_cols, bT+jj*n_b_rows);
+			}
 		}
-	}
+	});
 	delete[] bT;
 }
 #endif // __SSE__
 
+void batched_gemv(int M, int N, int K, const float* x, const float* w, const float* bias, float* y) {
+    const int strip = 64;
+    parallel_for(0, (N + strip - 1) / strip, [&](int begin, int end) {
+        int j_begin = begin * strip;
+        int j_end = min(end * strip, N);
+        for (int m = 0; m < M; ++m) {
+            memcpy(y + m*N + j_begin, bias + j_begin, (j_end - j_begin)*sizeof(float));
+        }
+        for (int k = 0; k < K; ++k) {
+            const float* w_row = w + k*N;
+            for (int m = 0; m < M; ++m) {
+                const float xk = x[m*K+k];
+                float* y_row = y + m*N;
+                int j = j_begin;
+#ifdef __SSE__
+                __m128 vx = _mm_set1_ps(xk);
+                for (; j + 4 <= j_end; j += 4) {
+                    __m128 vy = _mm_loadu_ps(y_row + j);
+                    vy = _mm_add_ps(vy, _mm_mul_ps(vx, _mm_loadu_ps(w_row + j)));
+                    _mm_storeu_ps(y_row + j, vy);
+                }
+#endif // __SSE__
+                for (; j < j_end; ++j) {
+                    y_row[j] += xk * w_row[j];
+                }
+            }
+        }
+    }, plane_grain(strip * K * M));
+}
+
 void eigen_filled(MatrixXf& X, const float* x) {
     int rows = X.rows(), cols = X.cols();
     for (int i = 0; i < rows; ++i) {
@@ -3,8 +3,12 @@
  * @auther yefajie
  * @data 2018/6/26
  **/
+#include <string.h>
+#include <mutex>
+#include <atomic>
 
 #include "net.h"
+#include "threadpool.h"
 #include "convolution.h"
 
 namespace micronet {
@@ -68,6 +72,9 @@ Net::Net(const string& net_name): net_name_(net_name), iter_(0) {
 
 void Net::set_optimizer(const shared_ptr<Optimizer>& optimizer) {
     optimizer_ = optimizer;
+    if (param_arena_) {
+        optimizer_->pack_state(param_arena_, arena_params_);
+    }
 }
 
 void Net::initialize() {
@@ -137,14 +144,18 @@ void Net::initialize() {
 
     while(net_sequences_.size() != all_layers_.size() + 1) {
         int size_flag = layer_inner_degree.size();
+        vector<layer_ptr> ready_layers;
         for (const auto& layer: layer_inner_degree) {
             if (layer.second == 0) {
-                net_sequences_.push_back(layer.first);
-                for (const auto& point_layer: net_graph_[layer.first]) {
-                    layer_inner_degree[point_layer] -= 1;
-                }
-                layer_inner_degree.erase(layer.first);
+                ready_layers.push_back(layer.first);
+            }
+        }
+        for (const auto& layer: ready_layers) {
+            net_sequences_.push_back(layer);
+            for (const auto& point_layer: net_graph_[layer]) {
+                layer_inner_degree[point_layer] -= 1;
             }
+            layer_inner_degree.erase(layer);
         }
         if (layer_inner_degree.size() == size_flag) {
             cout << "the graph built must be undirected..." << endl;
@@ -165,9 +176,454 @@ void Net::initialize() {
     cout << "Initialize net done !" << endl << endl;
 }
 
+void Net::inference(const string& input_key, const float* input, const vector<int>& input_shape,
+                    const string& output_key, float* output) {
+    if (!net_initialized_) {
+        cout << "net need to be initialized first!" << endl;
+        exit(1);
+    }
+    auto input_chunk = key_chunks_.find(input_key);
+    auto output_chunk = key_chunks_.find(output_key);
+    if (input_chunk == key_chunks_.end() || output_chunk == key_chunks_.end()) {
+        cout << "inference key chunks " << input_key << ", " << output_key << " not found!" << endl;
+        exit(1);
+    }
+    const chunk_ptr& in = input_chunk->second;
+    if (input_shape.size() != 4 || input_shape[1] != in->channels() ||
+        input_shape[2] != in->height() || input_shape[3] != in->width()) {
+        cout << "inference input shape must be (n, " << in->str_shape_exclude(0) << ")!" << endl;
+        exit(1);
+    }
+
+    materialize_params();
+    in->reshape(input_shape);
+    memcpy(in->data(), input, in->count()*sizeof(float));
+    forward_inference(output_key);
+    const chunk_ptr& out = output_chunk->second;
+    memcpy(output, out->const_data(), out->count()*sizeof(float));
+}
+
+const vector<layer_ptr>& Net::inference_sequence(const string& output_key) {
+    auto sequence = inference_sequences_.find(output_key);
+    if (sequence != inference_sequences_.end()) {
+        return sequence->second;
+    }
+
+    map<Chunk*, layer_ptr> producers;
+    for (const auto& layer: net_sequences_) {
+        for (const auto& chunk: layer->chunks_out_) {
+            producers[chunk.get()] = layer;
+        }
+    }
+    set<layer_ptr, layer_compare> needed;
+    queue<Chunk*> chunks;
+    chunks.push(key_chunks_.at(output_key).get());
+    while (!chunks.empty()) {
+        auto producer = producers.find(chunks.front());
+        chunks.pop();
+        if (producer == producers.end() || needed.find(producer->second) != needed.end()) {
+            continue;
+        }
+        needed.insert(producer->second);
+        for (const auto& chunk: producer->second->chunks_in_) {
+            chunks.push(chunk.get());
+        }
+    }
+
+    vector<layer_ptr>& layers = inference_sequences_[output_key];
+    for (const auto& layer: net_sequences_) {
+        if (needed.find(layer) != needed.end()) {
+            layers.push_back(layer);
+        }
+    }
+    return layers;
+}
+
+void Net::forward_inference(const string& output_key) {
+    const vector<layer_ptr>& sequence = inference_sequence(output_key);
+    set<Layer*> needed;
+    for (const auto& layer: sequence) {
+        needed.insert(layer.get());
+    }
+    execute_forward(false, [&needed](const layer_ptr& layer) {
+        return needed.count(layer.get()) > 0;
+    });
+}
+
+void Net::build_schedule() {
+    int num_layers = net_sequences_.size();
+    map<Chunk*, int> producer;
+    for (int i = 0; i < num_layers; ++i) {
+        for (const auto& chunk: net_sequences_[i]->chunks_out_) {
+            producer[chunk.get()] = i;
+        }
+        layer_op_time_[net_sequences_[i]->layer_name_];
+        layer_up_time_[net_sequences_[i]->layer_name_];
+    }
+
+    vector<set<int>> forward_next(num_layers), backward_next(num_layers);
+    map<Chunk*, vector<int>> diff_writers;
+    for (int i = 0; i < num_layers; ++i) {
+        for (const auto& chunk: net_sequences_[i]->chunks_in_) {
+            auto from = producer.find(chunk.get());
+            if (from != producer.end()) {
+                forward_next[from->second].insert(i);
+                backward_next[i].insert(from->second);
+            }
+            diff_writers[chunk.get()].push_back(i);
+        }
+        set<Chunk*> params;
+        for (const auto& param: net_sequences_[i]->params_) {
+            if (params.insert(param.get()).second) {
+                diff_writers[param.get()].push_back(i);
+            }
+        }
+    }
+    for (const auto& writers: diff_writers) {
+        for (int k = int(writers.second.size()) - 1; k > 0; --k) {
+            if (writers.second[k] != writers.second[k - 1]) {
+                backward_next[writers.second[k]].insert(writers.second[k - 1]);
+            }
+        }
+    }
+
+    forward_next_.assign(num_layers, {});
+    backward_next_.assign(num_layers, {});
+    for (int i = 0; i < num_layers; ++i) {
+        forward_next_[i].assign(forward_next[i].begin(), forward_next[i].end());
+        backward_next_[i].assign(backward_next[i].begin(), backward_next[i].end());
+    }
+}
+
+void Net::execute_forward(bool is_train, const layer_filter& filter) {
+    execute(false, is_train, filter);
+}
+
+void Net::execute_backward(const layer_filter& filter) {
+    execute(true, true, filter);
+}
+
+void Net::execute(bool is_backward, bool is_train, const layer_filter& filter, bool update_params) {
+    if (forward_next_.size() != net_sequences_.size()) {
+        build_schedule();
+    }
+    const vector<vector<int>>& next = is_backward? backward_next_: forward_next_;
+    int num_layers = net_sequences_.size();
+    vector<char> selected(num_layers);
+    unique_ptr<atomic<int>[]> pending(new atomic<int>[num_layers]);
+    for (int i = 0; i < num_layers; ++i) {
+        selected[i] = !filter || filter(net_sequences_[i]);
+        pending[i].store(0);
+    }
+    for (int i = 0; i < num_layers; ++i) {
+        for (int j: next[i]) {
+            if (selected[i] && selected[j]) {
+                pending[j]++;
+            }
+        }
+    }
+
+    // a trainable param is final once the last selected layer using it ran
+    // its backward, backward_next_ already orders the layers sharing it
+    vector<chunk_ptr> params;
+    vector<vector<int>> layer_params(num_layers);
+    unique_ptr<atomic<int>[]> users;
+    if (is_backward) {
+        map<Chunk*, int> param_index;
+        for (int i = 0; i < num_layers; ++i) {
+            if (!selected[i]) {
+                continue;
+            }
+            for (const auto& param: net_sequences_[i]->params_) {
+                if (!param->trainable()) {
+                    continue;
+                }
+                auto index = param_index.insert({param.get(), int(params.size())});
+                if (index.second) {
+                    params.push_back(param);
+                }
+                if (find(layer_params[i].begin(), layer_params[i].end(), index.first->second) == layer_params[i].end()) {
+                    layer_params[i].push_back(index.first->second);
+                }
+            }
+        }
+        users.reset(new atomic<int>[params.size()]);
+        for (int p = 0; p < int(params.size()); ++p) {
+            users[p].store(0);
+        }
+        for (int i = 0; i < num_layers; ++i) {
+            for (int p: layer_params[i]) {
+                users[p]++;
+            }
+        }
+    }
+
+    // the param gradients of a layer run after its backward returned, next to
+    // the earlier layers, unless another layer accumulates into the same diff
+    vector<char> collect(num_layers, 0);
+    for (int i = 0; i < num_layers && is_backward; ++i) {
+        collect[i] = selected[i] && all_of(layer_params[i].begin(), layer_params[i].end(),
+                                           [&users](int p) {return users[p].load() == 1;});
+    }
+
+    vector<int> threads(num_layers, 0);
+    if (!layer_threads_.empty() && !inputs_.empty()) {
+        for (int i = 0; i < num_layers; ++i) {
+            threads[i] = tuned_threads(net_sequences_[i]->layer_name_, inputs_[0]->num());
+        }
+    }
+
+    TaskGroup group(ThreadPool::instance());
+    function<void(int)> params_done = [&](int i) {
+        if (!update_params) {
+            return;
+        }
+        vector<int> final_params;
+        for (int p: layer_params[i]) {
+            if (--users[p] == 0) {
+                final_params.push_back(p);
+            }
+        }
+        if (!final_params.empty()) {
+            group.run([this, &params, final_params, i] {
+                Timer update_timer;
+                vector<chunk_ptr> layer_params;
+                for (int p: final_params) {
+                    layer_params.push_back(params[p]);
+                }
+                optimizer_->step(layer_params, iter_);
+                layer_up_time_[net_sequences_[i]->layer_name_] = update_timer.elapsed()*1000;
+            });
+        }
+    };
+    function<void(int)> run_layer = [&](int i) {
+        while (i >= 0) {
+            const layer_ptr& layer = net_sequences_[i];
+            unique_ptr<ExecContext> context(threads[i] > 0? new ExecContext(threads[i]): nullptr);
+            Timer timer;
+            if (is_backward) {
+                layer->collect_param_grads_ = collect[i];
+                layer->backward();
+                layer->collect_param_grads_ = false;
+                layer_op_time_[layer->layer_name_].second = timer.elapsed()*1000;
+                vector<function<void()>> param_grads;
+                param_grads.swap(layer->param_grads_);
+                if (param_grads.empty()) {
+                    params_done(i);
+                }
+                auto remaining = make_shared<atomic<int>>(int(param_grads.size()));
+                for (auto& task: param_grads) {
+                    group.run([&params_done, task, remaining, i] {
+                        task();
+                        if (--*remaining == 0) {
+                            params_done(i);
+                        }
+                    });
+                }
+            } else {
+                layer->forward(is_train);
+                layer_op_time_[layer->layer_name_].first = timer.elapsed()*1000;
+            }
+            // keep the first ready successor on this thread
+            int follow = -1;
+            for (int j: next[i]) {
+                if (selected[j] && --pending[j] == 0) {
+                    if (follow < 0) {
+                        follow = j;
+                    } else {
+                        group.run([&run_layer, j] {run_layer(j);});
+                    }
+                }
+            }
+            i = follow;
+        }
+    };
+    vector<int> ready;
+    for (int i = 0; i < num_layers; ++i) {
+        if (selected[i] && pending[i].load() == 0) {
+            ready.push_back(i);
+        }
+    }
+    for (int i: ready) {
+        group.run([&run_layer, i] {run_layer(i);});
+    }
+    group.wait();
+}
+
+int Net::tuned_threads(const string& layer_name, int batch_size) {
+    auto layer_threads = layer_threads_.find(layer_name);
+    if (layer_threads == layer_threads_.end() || layer_threads->second.empty()) {
+        return 0;
+    }
+    // the closest tuned batch size
+    const map<int, int>& tuned = layer_threads->second;
+    auto above = tuned.lower_bound(batch_size);
+    if (above == tuned.end()) {
+        return prev(above)->second;
+    }
+    if (above == tuned.begin() || above->first == batch_size) {
+        return above->second;
+    }
+    auto below = prev(above);
+    return batch_size - below->first <= above->first - batch_size? below->second: above->second;
+}
+
+void Net::autotune(int batch_size, vector<int> thread_counts, int repeats) {
+    if (!net_initialized_) {
+        cout << "net need to be initialized first!" << endl;
+        exit(1);
+    }
+    materialize_params();
+    Timer timer;
+    int max_threads = get_num_threads();
+    if (thread_counts.empty()) {
+        for (int t = 1; t < max_threads; t *= 2) {
+            thread_counts.push_back(t);
+        }
+        thread_counts.push_back(max_threads);
+    }
+
+    // calibration runs train mode forward, so keep params and layer counters
+    vector<chunk_ptr> params = unique_params();
+    vector<vector<float>> saved_params;
+    for (const auto& param: params) {
+        saved_params.push_back(vector<float>(param->const_data(), param->const_data() + param->count()));
+    }
+    vector<map<string, int>> saved_int_hps;
+    for (const auto& layer: net_sequences_) {
+        saved_int_hps.push_back(layer->int_hps_);
+    }
+    for (const auto& chunk: inputs_) {
+        chunk->reshape(batch_size, chunk->channels(), chunk->height(), chunk->width());
+        memset(chunk->data(), 0, chunk->count()*sizeof(float));
+    }
+
+    int num_layers = net_sequences_.size();
+    vector<vector<double>> layer_time(num_layers, vector<double>(thread_counts.size(), 0));
+    for (int r = -1; r < repeats; ++r) {
+        for (int t = 0; t < int(thread_counts.size()); ++t) {
+            ExecContext context(thread_counts[t]);
+            for (int i = 0; i < num_layers; ++i) {
+                Timer layer_timer;
+                net_sequences_[i]->forward(true);
+                if (r >= 0) {
+                    layer_time[i][t] += layer_timer.elapsed();
+                }
+            }
+            for (int i = num_layers - 1; i >= 0; --i) {
+                Timer layer_timer;
+                net_sequences_[i]->backward();
+                if (r >= 0) {
+                    layer_time[i][t] += layer_timer.elapsed();
+                }
+            }
+        }
+    }
+
+    // the fewest threads within TUNE_TOLERANCE of the best time, layers whose
+    // time does not change with the thread count keep the executor's share
+    const double TUNE_TOLERANCE = 0.05;
+    for (int i = 0; i < num_layers; ++i) {
+        const string& layer_name = net_sequences_[i]->layer_name_;
+        double fastest = *min_element(layer_time[i].begin(), layer_time[i].end());
+        double slowest = *max_element(layer_time[i].begin(), layer_time[i].end());
+        if (slowest - fastest <= TUNE_TOLERANCE * slowest) {
+            layer_threads_[layer_name].erase(batch_size);
+            if (layer_threads_[layer_name].empty()) {
+                layer_threads_.erase(layer_name);
+            }
+            cout << layer_name << ": not thread sensitive, "
+                 << fastest / max(repeats, 1) * 1000 << " ms" << endl;
+            continue;
+        }
+        int best = 0;
+        for (int t = 0; t < int(thread_counts.size()); ++t) {
+            if (layer_time[i][t] <= fastest * (1 + TUNE_TOLERANCE) &&
+                (layer_time[i][best] > fastest * (1 + TUNE_TOLERANCE) || thread_counts[t] < thread_counts[best])) {
+                best = t;
+            }
+        }
+        layer_threads_[layer_name][batch_size] = thread_counts[best];
+        cout << layer_name << ": " << thread_counts[best] << " threads, "
+             << layer_time[i][best] / max(repeats, 1) * 1000 << " ms" << endl;
+    }
+
+    for (int p = 0; p < int(params.size()); ++p) {
+        memcpy(params[p]->data(), saved_params[p].data(), saved_params[p].size()*sizeof(float));
+    }
+    for (int i = 0; i < num_layers; ++i) {
+        net_sequences_[i]->int_hps_ = saved_int_hps[i];
+    }
+    cout << "autotune batch size " << batch_size << " use time: " << timer.elapsed() << " s" << endl;
+}
+
+void Net::set_transforms(const string& key, const string& source, const vector<int>& source_shape,
+                         const vector<transform_ptr>& transforms) {
+    if (source_shape.size() != 3) {
+        cout << "source shape of " << key << " must be (channels, height, width)..." << endl;
+        exit(1);
+    }
+    input_stages_[key] = make_pair(source, DataStage{0, source_shape, transforms});
+}
+
+bool Net::has_data(const map<string, data_t>& data, const string& key) {
+    auto stage = input_stages_.find(key);
+    string source = stage == input_stages_.end()? key: stage->second.first;
+    return data.find(source) != data.end();
+}
+
+// Every rank of a process group gets an equal share of the samples, so all
+// ranks run the same number of steps.
+static data_t rank_shard(const data_t& data, const shared_ptr<ProcessGroup>& group) {
+    int world_size = group->world_size();
+    int shard_size = data.size() / world_size;
+    data_t shard;
+    shard.reserve(shard_size);
+    for (int i = 0; i < shard_size; ++i) {
+        shard.push_back(data[i * world_size + group->rank()]);
+    }
+    return shard;
+}
+
+shared_ptr<DataProvider> Net::make_provider(const map<string, data_t>& data, const vector<string>& keys,
+                                            bool shuffle, bool augment, bool shard) {
+    shard = shard && process_group_ && process_group_->world_size() > 1;
+    vector<data_t> data_vec;
+    if (input_stages_.empty()) {
+        for (const auto& key: keys) {
+            data_vec.push_back(shard? rank_shard(data.at(key), process_group_): data.at(key));
+        }
+        return make_shared<DataProvider>(data_vec, shuffle);
+    }
+
+    vector<string> sources;
+    vector<DataStage> stages;
+    for (const auto& key: keys) {
+        string source = key;
+        DataStage stage {0, {}, {}};
+        auto it = input_stages_.find(key);
+        if (it != input_stages_.end()) {
+            source = it->second.first;
+            stage = it->second.second;
+        }
+        auto index = find(sources.begin(), sources.end(), source);
+        stage.source = index - sources.begin();
+        if (index == sources.end()) {
+            sources.push_back(source);
+            data_vec.push_back(shard? rank_shard(data.at(source), process_group_): data.at(source));
+        }
+        if (stage.shape.empty()) {
+            stage.shape = {int(data.at(source)[0].size()), 1, 1};
+        }
+        stages.push_back(stage);
+    }
+    return make_shared<DataProvider>(data_vec, stages, shuffle, augment);
+}
+
 void Net::save_model(const string& save_path) {
     Timer timer;
 
+    materialize_params();
     json j_net;
     to_json(j_net, this);
     std::ofstream ofs(save_path);
@@ -179,15 +635,754 @@ void Net::save_model(const string& save_path) {
 void Net::load_model(const string& save_path) {
     Timer timer;
 
-    json j_net;
-    std::ifstream ifs(save_path);
-    ifs >> j_net;
-    from_json(j_net, this);
+    BlobSource blobs;
+    json j_net = read_json_model(save_path, blobs);
+    from_json(j_net, this, &blobs);
+    inference_sequences_.clear();
+    forward_next_.clear();
+    replicas_.clear();
+    replica_params_.clear();
+    param_arena_.reset();
+    arena_params_.clear();
 
     net_initialized_ = true;
+    params_materialized_ = true;
     cout << "load model use time: " << timer.elapsed() << " s" << endl;
 }
 
+void Net::save_binary_model(const string& save_path, bool fp16) {
+    Timer timer;
+
+    materialize_params();
+    json j_net;
+    to_json(j_net, this, false);
+    vector<ParamBlob> blobs;
+    vector<size_t> counts;
+    for (const auto& param: unique_params()) {
+        blobs.push_back({param->const_data(), size_t(param->count())});
+        counts.push_back(param->count());
+    }
+    assign_blob_offsets(j_net, counts, fp16);
+    if (!write_binary_model(save_path, j_net, blobs, fp16)) {
+        exit(1);
+    }
+
+    cout << "save binary model use time: " << timer.elapsed() << " s" << endl;
+}
+
+vector<chunk_ptr> Net::unique_params() {
+    vector<chunk_ptr> params;
+    set<Chunk*> seen;
+    for (const auto& layer: net_sequences_) {
+        for (const auto& param: layer->params_) {
+            if (seen.insert(param.get()).second) {
+                params.push_back(param);
+            }
+        }
+    }
+    return params;
+}
+
+void Net::materialize_params() {
+    if (params_materialized_) {
+        return;
+    }
+    Timer timer;
+    set<Chunk*> live, initialized;
+    for (const auto& param: unique_params()) {
+        live.insert(param.get());
+    }
+    vector<const ParamInit*> inits;
+    for (const auto& layer: net_sequences_) {
+        for (const auto& init: layer->param_inits_) {
+            if (live.count(init.param.get()) && initialized.insert(init.param.get()).second) {
+                inits.push_back(&init);
+            }
+        }
+    }
+
+    // fixed size blocks with their own seeds, so big weights fill in parallel
+    // and the values do not depend on the number of threads
+    const int block_size = 1 << 16;
+    vector<pair<const ParamInit*, int>> blocks;
+    for (const auto init: inits) {
+        for (int begin = 0; begin < init->param->count(); begin += block_size) {
+            blocks.push_back(make_pair(init, begin));
+        }
+    }
+    parallel_for(0, blocks.size(), [&](int begin, int end) {
+        for (int b = begin; b < end; ++b) {
+            const ParamInit* init = blocks[b].first;
+            int begin = blocks[b].second;
+            int n = min(block_size, init->param->count() - begin);
+            float* data = init->param->data() + begin;
+            if (init->init_type == "normal") {
+                int seed = int((unsigned(init->seed) + unsigned(begin / block_size) * 7919u) & 0x7fffffff);
+                normal_random_init(n, data, init->value1, init->value2, seed);
+            } else {
+                constant_init(n, data, init->value1);
+            }
+        }
+    });
+
+    for (const auto& layer: net_sequences_) {
+        layer->param_inits_.clear();
+    }
+    params_materialized_ = true;
+    cout << "materialize params use time: " << timer.elapsed() << " s" << endl;
+}
+
+// Packs the trainable params into one buffer, with their diffs in the diff of
+// the same buffer, so passes over all params walk one contiguous range. Every
+// slice starts on a STATE_BLOCK boundary, quantized optimizer state never
+// shares a block between params. Replicas are built from the packed params.
+void Net::pack_params() {
+    if (param_arena_) {
+        return;
+    }
+    materialize_params();
+    vector<pair<chunk_ptr, int>> packed;
+    int total = 0;
+    for (const auto& param: unique_params()) {
+        if (param->trainable()) {
+            packed.push_back({param, total});
+            total += (param->count() + STATE_BLOCK - 1) / STATE_BLOCK * STATE_BLOCK;
+        }
+    }
+    if (packed.empty()) {
+        return;
+    }
+    auto arena = make_shared<Chunk>(total, 1, 1, 1);
+    for (const auto& param: packed) {
+        float* data = arena->data() + param.second;
+        float* diff = arena->diff() + param.second;
+        memcpy(data, param.first->const_data(), param.first->count()*sizeof(float));
+        memcpy(diff, param.first->const_diff(), param.first->count()*sizeof(float));
+        param.first->share_data(data, arena);
+        param.first->share_diff(diff, arena);
+    }
+    param_arena_ = arena;
+    arena_params_ = packed;
+    optimizer_->pack_state(param_arena_, arena_params_);
+}
+
+// Steps the whole arena at once, layer-wise optimizers get the packed params
+// one by one for their trust ratios.
+void Net::step_arena() {
+    if (!optimizer_->layer_wise()) {
+        optimizer_->step({param_arena_}, iter_);
+        return;
+    }
+    vector<chunk_ptr> params;
+    for (const auto& param: arena_params_) {
+        params.push_back(param.first);
+    }
+    optimizer_->step(params, iter_);
+}
+
+void Net::reset_param_diffs() {
+    float* diff = param_arena_->diff();
+    parallel_for(0, param_arena_->count(), [diff](int begin, int end) {
+        memset(diff + begin, 0, (end - begin)*sizeof(float));
+    }, ELEMENTWISE_GRAIN);
+}
+
+// A copy of a net that only runs train forward and backward passes.
+class ReplicaNet: public Net {
+public:
+    explicit ReplicaNet(const string& net_name): Net(net_name) {};
+    virtual void fit(const map<string, data_t>& train_data, const map<string, data_t>& valid_data,
+                     int batch_size, int epochs, int verbose, bool shuffle,
+                     int accumulation_steps) override {
+        cout << "replica net can not fit!" << endl;
+        exit(1);
+    }
+    virtual void evaluate(const map<string, data_t>& data, int batch_size) override {
+        cout << "replica net can not evaluate!" << endl;
+        exit(1);
+    }
+    virtual data_t inference(const map<string, data_t>& data, int batch_size) override {
+        cout << "replica net can not inference!" << endl;
+        exit(1);
+    }
+
+protected:
+    virtual void forward(bool is_train, const string& layer_prefix) override {
+        execute_forward(is_train);
+    }
+    virtual void backward(const string& layer_prefix) override {
+        execute_backward();
+    }
+    virtual void update(const string& layer_prefix) override {
+    }
+};
+
+void Net::set_replicas(int num_replicas) {
+    num_replicas_ = max(1, num_replicas);
+    pipeline_stages_ = 1;
+    hogwild_ = false;
+    replicas_.clear();
+    replica_params_.clear();
+}
+
+void Net::set_pipeline(int num_stages, int num_micro_batches) {
+    set_replicas(num_micro_batches);
+    pipeline_stages_ = max(1, num_stages);
+}
+
+void Net::set_hogwild(int num_workers) {
+    set_replicas(num_workers);
+    hogwild_ = true;
+}
+
+void Net::build_replicas() {
+    pack_params();
+    Timer timer;
+    json j_net;
+    to_json(j_net, this, false);
+    replicas_.clear();
+    replica_params_.clear();
+    map<Chunk*, int> param_index;
+    for (int r = 0; r < num_replicas_; ++r) {
+        shared_ptr<Net> replica = make_shared<ReplicaNet>(net_name_);
+        from_json(j_net, replica.get(), nullptr);
+        replica->net_initialized_ = true;
+        replica->params_materialized_ = true;
+        replica->layer_threads_ = layer_threads_;
+        for (int i = 0; i < int(net_sequences_.size()); ++i) {
+            const auto& params = net_sequences_[i]->params_;
+            const auto& replica_params = replica->net_sequences_[i]->params_;
+            for (int p = 0; p < int(params.size()); ++p) {
+                auto index = param_index.find(params[p].get());
+                if (index == param_index.end()) {
+                    index = param_index.insert({params[p].get(), int(replica_params_.size())}).first;
+                    replica_params_.push_back({params[p], {}});
+                }
+                auto& copies = replica_params_[index->second].second;
+                if (int(copies.size()) == r) {
+                    copies.push_back(replica_params[p]);
+                    if (params[p]->trainable()) {
+                        replica_params[p]->share_data(params[p]->data(), params[p]);
+                    }
+                }
+            }
+        }
+        replicas_.push_back(replica);
+    }
+    cout << "build " << num_replicas_ << " replicas use time: " << timer.elapsed() << " s" << endl;
+}
+
+// One train step on the loaded batch. On a single replica without a process
+// group the updates overlap the backward pass, each layer's params go to the
+// optimizer while the earlier layers are still backpropagating.
+void Net::train_step() {
+    if (!overlap_update_ || num_replicas_ > 1 || process_group_) {
+        forward_backward();
+        update();
+        return;
+    }
+    pack_params();
+    if (param_arena_) {
+        reset_param_diffs();
+    }
+    forward(true);
+    iter_++;
+    optimizer_->begin_iter(iter_);
+    for (const auto& param: unique_params()) {
+        if (param->trainable()) {
+            optimizer_->prepare(param);
+        }
+    }
+    execute(true, true, nullptr, true);
+}
+
+// One optimizer step over accumulation_steps micro batches of batch_size. The
+// overlapped update needs the final diffs of a single backward pass, so
+// accumulated steps update once after the last micro batch.
+void Net::train_step(DataProvider& train, int batch_size, int accumulation_steps) {
+    if (accumulation_steps <= 1) {
+        train.load_batch(inputs_, batch_size);
+        train_step();
+        return;
+    }
+    accumulate(accumulation_steps, [&](int micro) {
+        train.load_batch(inputs_, batch_size);
+        forward_backward(true);
+    });
+    if (process_group_) {
+        exchange_gradients();
+    }
+    update();
+}
+
+// Runs micro_step accumulation_steps times, summing into the packed param
+// diffs, then averages them. Untrainable params (batch norm statistics) and
+// layer counters restart from their values before the step for every micro
+// batch and end as the micro batch average, so running statistics move once
+// per step as with replicas. Scalar outputs are averaged the same way.
+void Net::accumulate(int accumulation_steps, const function<void(int)>& micro_step) {
+    pack_params();
+    if (param_arena_) {
+        reset_param_diffs();
+    }
+    if (accumulation_steps <= 1) {
+        micro_step(0);
+        return;
+    }
+    vector<chunk_ptr> chunks;
+    for (const auto& param: unique_params()) {
+        if (!param->trainable()) {
+            chunks.push_back(param);
+        }
+    }
+    for (const auto& key_chunk: key_chunks_) {
+        const chunk_ptr& chunk = key_chunk.second;
+        if (chunk->count() == 1 && find(inputs_.begin(), inputs_.end(), chunk) == inputs_.end()) {
+            chunks.push_back(chunk);
+        }
+    }
+    vector<vector<float>> starts, sums;
+    for (const auto& chunk: chunks) {
+        starts.emplace_back(chunk->const_data(), chunk->const_data() + chunk->count());
+        sums.emplace_back(chunk->count(), 0.0f);
+    }
+    vector<map<string, int>> int_hps;
+    for (const auto& layer: net_sequences_) {
+        int_hps.push_back(layer->int_hps_);
+    }
+
+    for (int micro = 0; micro < accumulation_steps; ++micro) {
+        for (int c = 0; c < int(chunks.size()); ++c) {
+            memcpy(chunks[c]->data(), starts[c].data(), starts[c].size()*sizeof(float));
+        }
+        for (int i = 0; i < int(net_sequences_.size()); ++i) {
+            net_sequences_[i]->int_hps_ = int_hps[i];
+        }
+        micro_step(micro);
+        for (int c = 0; c < int(chunks.size()); ++c) {
+            const float* data = chunks[c]->const_data();
+            for (int j = 0; j < int(sums[c].size()); ++j) {
+                sums[c][j] += data[j];
+            }
+        }
+    }
+
+    float scale = 1.0f / accumulation_steps;
+    for (int c = 0; c < int(chunks.size()); ++c) {
+        float* data = chunks[c]->data();
+        for (int j = 0; j < int(sums[c].size()); ++j) {
+            data[j] = sums[c][j] * scale;
+        }
+    }
+    if (param_arena_) {
+        float* diff = param_arena_->diff();
+        parallel_for(0, param_arena_->count(), [diff, scale](int begin, int end) {
+            for (int j = begin; j < end; ++j) {
+                diff[j] *= scale;
+            }
+        }, ELEMENTWISE_GRAIN);
+    }
+}
+
+// Forward and backward of the loaded batch, then the gradient exchange with
+// the other ranks. When accumulating the diffs add to the ones already in the
+// arena and the exchange is left to the caller.
+void Net::forward_backward(bool accumulate) {
+    pack_params();
+    broadcast_params();
+    if (num_replicas_ <= 1) {
+        if (param_arena_ && !accumulate) {
+            reset_param_diffs();
+        }
+        forward(true);
+        backward();
+    } else {
+        replica_forward_backward(accumulate);
+    }
+    if (process_group_ && !accumulate) {
+        exchange_gradients();
+    }
+}
+
+// Ranks start from the params of rank 0.
+void Net::broadcast_params() {
+    if (!process_group_ || group_synced_) {
+        return;
+    }
+    vector<pair<float*, size_t>> params;
+    for (const auto& param: unique_params()) {
+        params.push_back({param->data(), size_t(param->count())});
+    }
+    process_group_->broadcast(params);
+    group_synced_ = true;
+}
+
+void Net::set_process_group(const shared_ptr<ProcessGroup>& group) {
+    process_group_ = group;
+    group_synced_ = false;
+}
+
+// Averages the param diffs, the untrainable params and the scalar outputs
+// over the ranks, every rank then applies the same update.
+void Net::exchange_gradients() {
+    vector<pair<float*, size_t>> buffers;
+    for (const auto& param: unique_params()) {
+        float* values = param->trainable()? param->diff(): param->data();
+        buffers.push_back({values, size_t(param->count())});
+    }
+    for (const auto& key_chunk: key_chunks_) {
+        const chunk_ptr& chunk = key_chunk.second;
+        if (chunk->count() == 1 && find(inputs_.begin(), inputs_.end(), chunk) == inputs_.end()) {
+            buffers.push_back({chunk->data(), 1});
+        }
+    }
+    process_group_->all_reduce_mean(buffers);
+}
+
+// With replicas every replica takes a contiguous slice of the batch, then the
+// diffs of the shared params are summed into this net weighted by slice size,
+// which for mean losses is the full batch gradient. Untrainable params (batch
+// norm statistics) and scalar outputs (loss, acc) are averaged the same way.
+// When accumulating the summed diffs add to the ones already there.
+void Net::replica_forward_backward(bool accumulate) {
+    if (int(replicas_.size()) != num_replicas_) {
+        build_replicas();
+    }
+    int batch_size = inputs_[0]->num();
+    int num_replicas = min(num_replicas_, batch_size);
+    vector<int> starts(num_replicas + 1, 0);
+    for (int r = 0; r < num_replicas; ++r) {
+        starts[r + 1] = starts[r] + batch_size / num_replicas + (r < batch_size % num_replicas);
+    }
+
+    parallel_for(0, num_replicas, [&](int begin, int end) {
+        for (int r = begin; r < end; ++r) {
+            Net* replica = replicas_[r].get();
+            int num = starts[r + 1] - starts[r];
+            for (int k = 0; k < int(inputs_.size()); ++k) {
+                const chunk_ptr& input = inputs_[k];
+                int sample_count = input->count() / input->num();
+                replica->inputs_[k]->reshape(num, input->channels(), input->height(), input->width());
+                memcpy(replica->inputs_[k]->data(), input->const_data() + starts[r] * sample_count,
+                       num * sample_count * sizeof(float));
+            }
+            for (const auto& param: replica_params_) {
+                if (!param.first->trainable()) {
+                    memcpy(param.second[r]->data(), param.first->const_data(), param.first->count()*sizeof(float));
+                }
+            }
+            for (int i = 0; i < int(net_sequences_.size()); ++i) {
+                replica->net_sequences_[i]->int_hps_ = net_sequences_[i]->int_hps_;
+            }
+            if (pipeline_stages_ <= 1) {
+                replica->forward(true);
+                replica->backward();
+            }
+        }
+    });
+    if (pipeline_stages_ > 1) {
+        pipeline_forward_backward(num_replicas);
+    }
+
+    vector<float> weights(num_replicas);
+    for (int r = 0; r < num_replicas; ++r) {
+        weights[r] = float(starts[r + 1] - starts[r]) / batch_size;
+    }
+    // all reduce, element ranges in parallel and replicas summed in order
+    for (const auto& param: replica_params_) {
+        bool trainable = param.first->trainable();
+        float* target = trainable? param.first->diff(): param.first->data();
+        parallel_for(0, param.first->count(), [&](int begin, int end) {
+            for (int j = begin; j < end; ++j) {
+                float value = 0;
+                for (int r = 0; r < num_replicas; ++r) {
+                    const float* source = trainable? param.second[r]->const_diff(): param.second[r]->const_data();
+                    value += weights[r] * source[j];
+                }
+                target[j] = trainable && accumulate? target[j] + value: value;
+            }
+        }, ELEMENTWISE_GRAIN);
+    }
+    for (const auto& key_chunk: key_chunks_) {
+        const chunk_ptr& chunk = key_chunk.second;
+        if (chunk->count() != 1 || find(inputs_.begin(), inputs_.end(), chunk) != inputs_.end()) {
+            continue;
+        }
+        float value = 0;
+        for (int r = 0; r < num_replicas; ++r) {
+            value += weights[r] * replicas_[r]->key_chunks_[key_chunk.first]->const_data()[0];
+        }
+        chunk->data()[0] = value;
+    }
+    for (int i = 0; i < int(net_sequences_.size()); ++i) {
+        net_sequences_[i]->int_hps_ = replicas_[0]->net_sequences_[i]->int_hps_;
+    }
+}
+
+// One epoch of asynchronous training. Every worker owns a replica, loads its
+// own batches and applies its updates straight to the shared params, with no
+// locks besides taking batches off the data provider and saving checkpoints.
+// Ranks of a process group train their shards on their own and average the
+// params at the end of the epoch. Returns the scalar outputs summed over steps.
+map<string, float> Net::hogwild_epoch(DataProvider& train, int batch_size, int steps) {
+    if (optimizer_->optimizer_type_ == "Adam" || optimizer_->optimizer_type_ == "LAMB") {
+        cout << "hogwild training needs an optimizer without per iteration state, use SGD, AdaGrad, RMSProb or LARS!" << endl;
+        exit(1);
+    }
+    if (int(replicas_.size()) != num_replicas_) {
+        build_replicas();
+    }
+    for (const auto& param: replica_params_) {
+        if (param.first->trainable()) {
+            optimizer_->prepare(param.first);
+            for (const auto& copy: param.second) {
+                optimizer_->share_state(copy, param.first);
+            }
+        }
+    }
+
+    broadcast_params();
+
+    Timer timer;
+    mutex load_lock, checkpoint_lock;
+    atomic<int> next_step(0), updates(0);
+    int base_iter = iter_;
+    vector<map<string, float>> sums(num_replicas_);
+    vector<long long> staleness(num_replicas_, 0);
+    vector<int> max_staleness(num_replicas_, 0);
+    parallel_for(0, num_replicas_, [&](int begin, int end) {
+        for (int r = begin; r < end; ++r) {
+            Net* replica = replicas_[r].get();
+            for (const auto& param: replica_params_) {
+                if (!param.first->trainable()) {
+                    memcpy(param.second[r]->data(), param.first->const_data(), param.first->count()*sizeof(float));
+                }
+            }
+            for (int i = 0; i < int(net_sequences_.size()); ++i) {
+                replica->net_sequences_[i]->int_hps_ = net_sequences_[i]->int_hps_;
+            }
+            Batch batch;
+            while (next_step++ < steps) {
+                // only taking the batch is serialized, the transforms run outside the lock
+                {
+                    lock_guard<mutex> lock(load_lock);
+                    train.next_batch(batch_size, batch);
+                }
+                train.load_batch(replica->inputs_, batch);
+                int version = updates.load();
+                replica->forward(true);
+                replica->backward();
+                int applied = updates++;
+                for (const auto& param: replica_params_) {
+                    if (param.first->trainable()) {
+                        optimizer_->optimize(param.second[r], base_iter + applied + 1);
+                    }
+                }
+                // the snapshot races with the other workers like their updates do
+                if (checkpoint_due(base_iter + applied + 1)) {
+                    lock_guard<mutex> lock(checkpoint_lock);
+                    checkpointer_->save(base_iter + applied + 1);
+                }
+                staleness[r] += applied - version;
+                max_staleness[r] = max(max_staleness[r], applied - version);
+                for (const auto& key_chunk: replica->key_chunks_) {
+                    if (key_chunk.second->count() == 1 &&
+                        find(replica->inputs_.begin(), replica->inputs_.end(), key_chunk.second) == replica->inputs_.end()) {
+                        sums[r][key_chunk.first] += key_chunk.second->const_data()[0];
+                    }
+                }
+            }
+        }
+    });
+
+    int num_updates = updates.load();
+    iter_ = base_iter + num_updates;
+    for (const auto& param: replica_params_) {
+        if (!param.first->trainable()) {
+            float* data = param.first->data();
+            for (int j = 0; j < param.first->count(); ++j) {
+                float value = 0;
+                for (const auto& copy: param.second) {
+                    value += copy->const_data()[j];
+                }
+                data[j] = value / param.second.size();
+            }
+        }
+    }
+    for (int i = 0; i < int(net_sequences_.size()); ++i) {
+        net_sequences_[i]->int_hps_ = replicas_[0]->net_sequences_[i]->int_hps_;
+    }
+    if (process_group_) {
+        vector<pair<float*, size_t>> params;
+        for (const auto& param: unique_params()) {
+            params.push_back({param->data(), size_t(param->count())});
+        }
+        process_group_->all_reduce_mean(params);
+    }
+
+    map<string, float> totals;
+    hogwild_stats_ = HogwildStats();
+    hogwild_stats_.updates = num_updates;
+    hogwild_stats_.samples_per_second = double(num_updates) * batch_size / max(timer.elapsed(), 1e-9);
+    for (int r = 0; r < num_replicas_; ++r) {
+        for (const auto& sum: sums[r]) {
+            totals[sum.first] += sum.second;
+        }
+        hogwild_stats_.mean_staleness += double(staleness[r]) / max(num_updates, 1);
+        hogwild_stats_.max_staleness = max(hogwild_stats_.max_staleness, max_staleness[r]);
+    }
+    stringstream stats;
+    stats << "hogwild: " << num_replicas_ << " workers, " << fixed << setprecision(1) <<
+             hogwild_stats_.samples_per_second << " samples/s, staleness mean: " << setprecision(2) <<
+             hogwild_stats_.mean_staleness << ", max: " << hogwild_stats_.max_staleness;
+    cout << stats.str() << endl;
+    return totals;
+}
+
+// First layer index of every stage plus the end, contiguous runs of
+// net_sequences_ with about equal forward + backward time as measured by the
+// first replica, equal layer counts before anything was measured.
+vector<int> Net::pipeline_partition(int num_stages) {
+    int num_layers = net_sequences_.size();
+    num_stages = min(num_stages, num_layers);
+    vector<double> cost(num_layers, 0);
+    double total = 0;
+    for (int i = 0; i < num_layers; ++i) {
+        auto time = replicas_[0]->layer_op_time_.find(net_sequences_[i]->layer_name_);
+        if (time != replicas_[0]->layer_op_time_.end()) {
+            cost[i] = time->second.first + time->second.second;
+        }
+        total += cost[i];
+    }
+    if (total <= 0) {
+        fill(cost.begin(), cost.end(), 1.0);
+        total = num_layers;
+    }
+    vector<int> bounds = {0};
+    double prefix = 0;
+    for (int i = 0; i < num_layers; ++i) {
+        prefix += cost[i];
+        int stage = bounds.size();
+        int layers_left = num_layers - i - 1;
+        int stages_left = num_stages - stage;
+        if (stage < num_stages && layers_left >= stages_left &&
+            (prefix >= total * stage / num_stages || layers_left == stages_left)) {
+            bounds.push_back(i + 1);
+        }
+    }
+    bounds.push_back(num_layers);
+    return bounds;
+}
+
+// Splits the cores this process may run on into num_stages contiguous
+// groups, none when there are fewer cores than stages.
+static vector<vector<int>> stage_cores(int num_stages) {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    vector<int> cores;
+    if (sched_getaffinity(0, sizeof(cpu_set), &cpu_set) == 0) {
+        for (int core = 0; core < CPU_SETSIZE; ++core) {
+            if (CPU_ISSET(core, &cpu_set)) {
+                cores.push_back(core);
+            }
+        }
+    }
+    vector<vector<int>> groups(num_stages);
+    if (int(cores.size()) < num_stages) {
+        return groups;
+    }
+    for (int s = 0; s < num_stages; ++s) {
+        groups[s].assign(cores.begin() + cores.size() * s / num_stages,
+                         cores.begin() + cores.size() * (s + 1) / num_stages);
+    }
+    return groups;
+}
+
+// GPipe schedule over the replicas, one micro batch each. At tick t stage s
+// runs the forward of micro batch t - s, then the backward wave goes from the
+// last stage back. All stages of a tick run in parallel on their own share of
+// the pool and touch different replicas, so nothing is locked; diffs are
+// accumulated into this net by the caller once the wave drains. Every stage
+// runs on its own group of cores, whichever workers pick it up, so its
+// weights stay in the caches of those cores from tick to tick.
+void Net::pipeline_forward_backward(int num_micro_batches) {
+    vector<int> bounds = pipeline_partition(pipeline_stages_);
+    int num_stages = bounds.size() - 1;
+    if (int(pipeline_cores_.size()) != num_stages) {
+        pipeline_cores_ = stage_cores(num_stages);
+    }
+    vector<map<Layer*, int>> stage_of(num_micro_batches);
+    for (int m = 0; m < num_micro_batches; ++m) {
+        for (int s = 0; s < num_stages; ++s) {
+            for (int i = bounds[s]; i < bounds[s + 1]; ++i) {
+                stage_of[m][replicas_[m]->net_sequences_[i].get()] = s;
+            }
+        }
+    }
+
+    for (int is_backward = 0; is_backward < 2; ++is_backward) {
+        for (int tick = 0; tick < num_micro_batches + num_stages - 1; ++tick) {
+            parallel_for(0, num_stages, [&](int begin, int end) {
+                for (int s = begin; s < end; ++s) {
+                    int stage = is_backward? num_stages - 1 - s: s;
+                    int m = tick - s;
+                    if (m < 0 || m >= num_micro_batches) {
+                        continue;
+                    }
+                    ExecContext context(ExecContext::current_threads(), pipeline_cores_[stage]);
+                    const map<Layer*, int>& stages = stage_of[m];
+                    layer_filter in_stage = [&stages, stage](const layer_ptr& layer) {
+                        return stages.at(layer.get()) == stage;
+                    };
+                    if (is_backward) {
+                        replicas_[m]->execute_backward(in_stage);
+                    } else {
+                        replicas_[m]->execute_forward(true, in_stage);
+                    }
+                }
+            });
+        }
+    }
+}
+
+void Net::set_checkpointer(const shared_ptr<Checkpointer>& checkpointer, int interval) {
+    checkpointer_ = checkpointer;
+    checkpoint_interval_ = interval;
+}
+
+bool Net::checkpoint_due(int iter) const {
+    if (process_group_ && process_group_->rank() != 0) {
+        return false;
+    }
+    return checkpointer_ && checkpoint_interval_ > 0 && iter % checkpoint_interval_ == 0;
+}
+
+void Net::checkpoint_step() {
+    if (checkpoint_due(iter_)) {
+        checkpointer_->save(iter_);
+    }
+}
+
+void Net::load_binary_model(const string& save_path) {
+    Timer timer;
+
+    auto file = make_shared<MappedFile>(save_path);
+    size_t blobs_offset = 0;
+    json j_net = read_binary_header(*file, blobs_offset);
+    BlobSource blobs {file->data() + blobs_offset, file, file->size() - blobs_offset};
+    from_json(j_net, this, &blobs);
+    inference_sequences_.clear();
+    forward_next_.clear();
+    replicas_.clear();
+    replica_params_.clear();
+    param_arena_.reset();
+    arena_params_.clear();
+
+    net_initialized_ = true;
+    params_materialized_ = true;
+    cout << "load binary model use time: " << timer.elapsed() << " s" << endl;
+}
+
 void Net::print_net() {
     for (const auto& layer: net_sequences_) {
         cout << layer->layer_type_ << ": " << setw(20) << layer->layer_name_ << endl;
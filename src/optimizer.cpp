@@ -4,6 +4,7 @@
  * @data 2018/6/25
  **/
 #include "optimizer.h"
+#include "threadpool.h"
 
 namespace micronet {
 
@@ -11,4 +12,105 @@ Optimizer::Optimizer(const string& optimizer_type, vector<float> decay_locs):
     optimizer_type_(optimizer_type), decay_locs_(decay_locs) {
 }
 
+void Optimizer::optimize(const shared_ptr<Chunk>& param, int iter) {
+    step({param}, iter);
+}
+
+void Optimizer::step(const vector<shared_ptr<Chunk>>& params, int iter) {
+    StepHps hps = resolve(iter);
+    vector<StepBuffers> param_buffers;
+    // param index and begin of grain sized element ranges over all params
+    vector<pair<int, int>> ranges;
+    for (int p = 0; p < int(params.size()); ++p) {
+        param_buffers.push_back(buffers(params[p]));
+        param_buffers.back().trust_ratio = 1;
+        for (int begin = 0; begin < params[p]->count(); begin += ELEMENTWISE_GRAIN) {
+            ranges.push_back({p, begin});
+        }
+    }
+    if (layer_wise()) {
+        // one norm pass over all ranges, summed per param in range order so
+        // the trust ratios do not depend on the number of threads
+        vector<pair<double, double>> norms(ranges.size(), {0.0, 0.0});
+        parallel_for(0, ranges.size(), [&](int begin, int end) {
+            for (int r = begin; r < end; ++r) {
+                int p = ranges[r].first;
+                int range_begin = ranges[r].second;
+                accumulate_norms(hps, param_buffers[p], range_begin,
+                                 min(range_begin + ELEMENTWISE_GRAIN, params[p]->count()),
+                                 norms[r].first, norms[r].second);
+            }
+        });
+        vector<pair<double, double>> param_norms(params.size(), {0.0, 0.0});
+        for (int r = 0; r < int(ranges.size()); ++r) {
+            param_norms[ranges[r].first].first += norms[r].first;
+            param_norms[ranges[r].first].second += norms[r].second;
+        }
+        for (int p = 0; p < int(params.size()); ++p) {
+            param_buffers[p].trust_ratio = trust_ratio(hps, std::sqrt(param_norms[p].first),
+                                                       std::sqrt(param_norms[p].second));
+        }
+    }
+    parallel_for(0, ranges.size(), [&](int begin, int end) {
+        for (int r = begin; r < end; ++r) {
+            int p = ranges[r].first;
+            int range_begin = ranges[r].second;
+            update(hps, param_buffers[p], range_begin, min(range_begin + ELEMENTWISE_GRAIN, params[p]->count()));
+        }
+    });
+}
+
+float Optimizer::decayed_learning_rate(int iter) const {
+    float decay_loc = (float)iter / total_iters_;
+    int decay_index = find_if(decay_locs_.begin(), decay_locs_.end(),
+                              [&decay_loc](float loc) {return loc > decay_loc;}) - decay_locs_.begin();
+    float learning_rate = flt_hps_.at("learning_rate") * pow(0.1, decay_index);
+    return learning_rate;
+}
+
+void Optimizer::share_state(const shared_ptr<Chunk>& copy, const shared_ptr<Chunk>& param) {
+    if (copy != param) {
+        state_aliases_[copy.get()] = state_key(param);
+    }
+}
+
+Chunk* Optimizer::state_key(const shared_ptr<Chunk>& param) const {
+    auto alias = state_aliases_.find(param.get());
+    return alias != state_aliases_.end()? alias->second: param.get();
+}
+
+void Optimizer::pack_state(const shared_ptr<Chunk>& arena, const vector<pair<shared_ptr<Chunk>, int>>& params) {
+    state_views_.clear();
+    for (const auto& param: params) {
+        state_views_[param.first.get()] = {arena.get(), param.second};
+    }
+}
+
+Chunk& Optimizer::state(map<Chunk*, Chunk>& states, const shared_ptr<Chunk>& param) {
+    Chunk* key = state_key(param);
+    auto found = states.find(key);
+    if (found != states.end()) {
+        return found->second;
+    }
+    auto view = state_views_.find(key);
+    // state chunks never use their diff
+    if (view == state_views_.end()) {
+        Chunk& param_state = states[key] = Chunk(param->shape());
+        param_state.share_diff(nullptr, nullptr);
+        return param_state;
+    }
+    Chunk* arena = view->second.first;
+    auto arena_state = states.find(arena);
+    if (arena_state == states.end()) {
+        arena_state = states.insert({arena, Chunk(arena->shape())}).first;
+        arena_state->second.share_diff(nullptr, nullptr);
+    }
+    // the arena's entry owns the memory and lives as long as the view
+    Chunk& param_state = states[key];
+    param_state.shape_ = param->shape();
+    float* data = arena_state->second.data() + view->second.second;
+    param_state.share_data(data, shared_ptr<void>(data, [](void*) {}));
+    return param_state;
+}
+
 } // namespace micronet
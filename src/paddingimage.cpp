@@ -1,5 +1,5 @@
-#include <omp.h>
 #include "paddingimage.h"
+#include "threadpool.h"
 
 namespace micronet {
 
@@ -45,18 +45,19 @@ void PaddingImage::forward(bool is_train) {
 
     chunk_ptr in_chunk = chunks_in_[0];
     chunk_ptr out_chunk = chunks_out_[0];
-    #pragma omp parallel for
-    for (int n = 0; n < num; ++n) {
-        for (int c = 0; c < channels; ++c) {
-            for (int row = 0; row < height; ++row) {
-                for (int col = 0; col < width; ++col) {
-                    const int iindex = in_chunk->offset(n, c, row, col);
-                    const int oindex = out_chunk->offset(n, c, row+padding_top, col+padding_left);
-                    output_data[oindex] = input_data[iindex];
+    parallel_for(0, num, [&](int begin, int end) {
+        for (int n = begin; n < end; ++n) {
+            for (int c = 0; c < channels; ++c) {
+                for (int row = 0; row < height; ++row) {
+                    for (int col = 0; col < width; ++col) {
+                        const int iindex = in_chunk->offset(n, c, row, col);
+                        const int oindex = out_chunk->offset(n, c, row+padding_top, col+padding_left);
+                        output_data[oindex] = input_data[iindex];
+                    }
                 }
             }
         }
-    }
+    });
 
     gradient_reset();
 }
@@ -75,18 +76,19 @@ void PaddingImage::backward() {
 
     chunk_ptr in_chunk = chunks_in_[0];
     chunk_ptr out_chunk = chunks_out_[0];
-    #pragma omp parallel for
-    for (int n = 0; n < num; ++n) {
-        for (int c = 0; c < channels; ++c) {
-            for (int row = 0; row < height; ++row) {
-                for (int col = 0; col < width; ++col) {
-                    const int iindex = in_chunk->offset(n, c, row, col);
-                    const int oindex = out_chunk->offset(n, c, row+padding_top, col+padding_left);
-                    input_diff[iindex] += output_diff[oindex];
+    parallel_for(0, num, [&](int begin, int end) {
+        for (int n = begin; n < end; ++n) {
+            for (int c = 0; c < channels; ++c) {
+                for (int row = 0; row < height; ++row) {
+                    for (int col = 0; col < width; ++col) {
+                        const int iindex = in_chunk->offset(n, c, row, col);
+                        const int oindex = out_chunk->offset(n, c, row+padding_top, col+padding_left);
+                        input_diff[iindex] += output_diff[oindex];
+                    }
                 }
             }
         }
-    }
+    });
 }
 
 vector<int> PaddingImage::shape_inference() {
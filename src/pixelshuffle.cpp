@@ -1,4 +1,5 @@
 #include "pixelshuffle.h"
+#include "threadpool.h"
 
 namespace micronet {
 
@@ -34,8 +35,11 @@ void PixelShuffle::forward(bool is_train) {
     float* out_data = out_chunk->data();
     int upscale_factor = int_hps_["upscale_factor"];
 
-    for (int n = 0; n < in_chunk->num(); ++n) {
-        for (int c = 0; c < in_chunk->channels(); ++c) {
+    const int num = in_chunk->num();
+    const int channels = in_chunk->channels();
+    parallel_for(0, num * channels, [&](int begin, int end) {
+        for (int nc = begin; nc < end; ++nc) {
+            const int n = nc / channels, c = nc % channels;
             for (int h = 0; h < in_chunk->height(); ++h) {
                 for (int w = 0; w < in_chunk->width(); ++w) {
                     const int oc = c / (upscale_factor * upscale_factor);
@@ -49,7 +53,7 @@ void PixelShuffle::forward(bool is_train) {
                 }
             }
         }
-    }
+    }, plane_grain(in_chunk->height() * in_chunk->width()));
     gradient_reset();
 }
 
@@ -61,8 +65,11 @@ void PixelShuffle::backward() {
     float* in_diff = in_chunk->diff();
     int upscale_factor = int_hps_["upscale_factor"];
 
-    for (int n = 0; n < in_chunk->num(); ++n) {
-        for (int c = 0; c < in_chunk->channels(); ++c) {
+    const int num = in_chunk->num();
+    const int channels = in_chunk->channels();
+    parallel_for(0, num * channels, [&](int begin, int end) {
+        for (int nc = begin; nc < end; ++nc) {
+            const int n = nc / channels, c = nc % channels;
             for (int h = 0; h < in_chunk->height(); ++h) {
                 for (int w = 0; w < in_chunk->width(); ++w) {
                     const int oc = c / (upscale_factor * upscale_factor);
@@ -76,7 +83,7 @@ void PixelShuffle::backward() {
                 }
             }
         }
-    }
+    }, plane_grain(in_chunk->height() * in_chunk->width()));
 }
 
 vector<int> PixelShuffle::shape_inference() {
@@ -7,9 +7,9 @@
 #include <cmath>
 #include <iostream>
 #include <thread>
-#include <omp.h>
 #include "pooling.h"
 #include "util.h"
+#include "threadpool.h"
 
 namespace micronet {
 
@@ -76,9 +76,9 @@ void Pooling::forward(bool is_train) {
 
     if (pooling == "max") {
         float* mask_data = mask_->data();
-        #pragma omp parallel for
-        for (int n = 0; n < num; ++n) {
-            for (int c = 0; c < channels; ++c) {
+        parallel_for(0, num * channels, [&](int begin, int end) {
+            for (int nc = begin; nc < end; ++nc) {
+                const int n = nc / channels, c = nc % channels;
                 for (int oh = 0; oh < output_h; ++oh) {
                     for (int ow = 0; ow <output_w; ++ow) {
                         int hstart = oh * stride_h - pad_h;
@@ -102,11 +102,11 @@ void Pooling::forward(bool is_train) {
                     }
                 }
             }
-        }
+        }, plane_grain(output_h * output_w * kernel_h * kernel_w));
     } else if (pooling == "avg") {
-        #pragma omp parallel for
-        for (int n = 0; n < num; ++n) {
-            for (int c = 0; c < channels; ++c) {
+        parallel_for(0, num * channels, [&](int begin, int end) {
+            for (int nc = begin; nc < end; ++nc) {
+                const int n = nc / channels, c = nc % channels;
                 for (int oh = 0; oh < output_h; ++oh) {
                     for (int ow = 0; ow <output_w; ++ow) {
                         int hstart = oh * stride_h - pad_h;
@@ -128,13 +128,15 @@ void Pooling::forward(bool is_train) {
                     }
                 }
             }
-        }
+        }, plane_grain(output_h * output_w * kernel_h * kernel_w));
     } else if (pooling == "random") {
-        UniformGenerator generator(0.0f, 1.0f);
+        // a generator per chunk, the engine is not safe to share between threads
+        unsigned base_seed = UniformGenerator(0.0f, 1.0f).generator();
         float* mask_data = mask_->data();
-        #pragma omp parallel for
-        for (int n = 0; n < num; ++n) {
-            for (int c = 0; c < channels; ++c) {
+        parallel_for(0, num * channels, [&](int begin, int end) {
+            UniformGenerator generator(0.0f, 1.0f, int(base_seed + begin));
+            for (int nc = begin; nc < end; ++nc) {
+                const int n = nc / channels, c = nc % channels;
                 for (int oh = 0; oh < output_h; ++oh) {
                     for (int ow = 0; ow <output_w; ++ow) {
                         int hstart = oh * stride_h - pad_h;
@@ -166,7 +168,7 @@ void Pooling::forward(bool is_train) {
                     }
                 }
             }
-        }
+        }, plane_grain(output_h * output_w * kernel_h * kernel_w));
     }
     //cout << "pooling forward time:" << timer.elapsed()*1000 << endl;
     //exit(0);
@@ -199,9 +201,9 @@ void Pooling::backward() {
     float* input_diff = in_chunk->diff();
     if (pooling == "max" || pooling == "random") {
         const float* mask_data = mask_->const_data();
-        #pragma omp parallel for
-        for (int n = 0; n < num; ++n) {
-            for (int c = 0; c < channels; ++c) {
+        parallel_for(0, num * channels, [&](int begin, int end) {
+            for (int nc = begin; nc < end; ++nc) {
+                const int n = nc / channels, c = nc % channels;
                 for (int oh = 0; oh < output_h; ++oh) {
                     for (int ow = 0; ow <output_w; ++ow) {
                         const int oindex = out_chunk->offset(n, c, oh, ow);
@@ -210,11 +212,11 @@ void Pooling::backward() {
                     }
                 }
             }
-        }
+        }, plane_grain(output_h * output_w * kernel_h * kernel_w));
     } else if (pooling == "avg") {
-        #pragma omp parallel for
-        for (int n = 0; n < num; ++n) {
-            for (int c = 0; c < channels; ++c) {
+        parallel_for(0, num * channels, [&](int begin, int end) {
+            for (int nc = begin; nc < end; ++nc) {
+                const int n = nc / channels, c = nc % channels;
                 for (int oh = 0; oh < output_h; ++oh) {
                     for (int ow = 0; ow <output_w; ++ow) {
                         int hstart = oh * stride_h - pad_h;
@@ -234,7 +236,7 @@ void Pooling::backward() {
                     }
                 }
             }
-        }
+        }, plane_grain(output_h * output_w * kernel_h * kernel_w));
     }
     //cout << "pooling back time:" << timer.elapsed()*1000 << endl;
     //exit(0);
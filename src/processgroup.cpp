@@ -0,0 +1,258 @@
+/**
+ * @file processgroup.cpp
+ * @auther yefajie
+ * @data 2026/10/19
+ **/
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <time.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <atomic>
+#include <iostream>
+#include <string>
+
+#include "processgroup.h"
+#include "allocator.h"
+#include "threadpool.h"
+
+namespace micronet {
+
+// the last rank to arrive resets arrived and bumps generation, the others
+// sleep on generation with a timeout and check their peers in between
+struct SharedHeader {
+    atomic<int> arrived;
+    atomic<int> generation;
+};
+
+static const long BARRIER_POLL_NS = 100 * 1000 * 1000;
+
+// slots and the result buffer start on their own cache lines
+static size_t header_bytes() {
+    return (sizeof(SharedHeader) + 63) / 64 * 64;
+}
+
+static void copy_flat(const vector<pair<float*, size_t>>& buffers, size_t start, size_t count,
+                      float* flat, bool to_flat) {
+    size_t offset = 0;
+    for (const auto& buffer: buffers) {
+        size_t begin = max(start, offset);
+        size_t end = min(start + count, offset + buffer.second);
+        if (begin < end) {
+            float* data = buffer.first + (begin - offset);
+            float* piece = flat + (begin - start);
+            if (to_flat) {
+                memcpy(piece, data, (end - begin) * sizeof(float));
+            } else {
+                memcpy(data, piece, (end - begin) * sizeof(float));
+            }
+        }
+        offset += buffer.second;
+    }
+}
+
+static size_t total_count(const vector<pair<float*, size_t>>& buffers) {
+    size_t total = 0;
+    for (const auto& buffer: buffers) {
+        total += buffer.second;
+    }
+    return total;
+}
+
+shared_ptr<ProcessGroup> ProcessGroup::launch(int world_size, size_t slot_floats) {
+    if (thread_pool_started()) {
+        cout << "ProcessGroup::launch must be called before the thread pool starts!" << endl;
+        exit(1);
+    }
+    world_size = max(1, world_size);
+    size_t shared_bytes = header_bytes() + (world_size + 1) * slot_floats * sizeof(float);
+
+    string name = "/micronet-" + to_string(getpid());
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        cout << "shm_open " << name << " failed!" << endl;
+        exit(1);
+    }
+    if (ftruncate(fd, shared_bytes) != 0) {
+        cout << "ftruncate " << name << " failed!" << endl;
+        exit(1);
+    }
+    void* shared = mmap(nullptr, shared_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    // the children inherit the mapping, the name is not needed any more
+    shm_unlink(name.c_str());
+    if (shared == MAP_FAILED) {
+        cout << "mmap " << name << " failed!" << endl;
+        exit(1);
+    }
+
+    SharedHeader* header = new (shared) SharedHeader;
+    header->arrived.store(0);
+    header->generation.store(0);
+
+    pid_t launcher = getpid();
+    vector<pid_t> children;
+    int rank = 0;
+    for (int r = 1; r < world_size; ++r) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            cout << "fork rank " << r << " failed!" << endl;
+            exit(1);
+        }
+        if (pid == 0) {
+            rank = r;
+            children.clear();
+            break;
+        }
+        children.push_back(pid);
+    }
+    pin_to_node(rank);
+
+    shared_ptr<ProcessGroup> group(new ProcessGroup(rank, world_size, slot_floats, shared, shared_bytes));
+    group->children_ = children;
+    group->launcher_ = launcher;
+    return group;
+}
+
+void ProcessGroup::pin_to_node(int rank) {
+    vector<vector<int>> nodes = numa_node_cores();
+    if (nodes.size() < 2) {
+        return;
+    }
+    const vector<int>& cores = nodes[rank % nodes.size()];
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (int core: cores) {
+        CPU_SET(core, &cpu_set);
+    }
+    if (sched_setaffinity(0, sizeof(cpu_set), &cpu_set) != 0) {
+        cout << "pin rank " << rank << " to node " << rank % nodes.size() << " failed!" << endl;
+        return;
+    }
+    if (getenv("MICRONET_NUM_THREADS") == nullptr) {
+        setenv("MICRONET_NUM_THREADS", to_string(cores.size()).c_str(), 1);
+    }
+}
+
+ProcessGroup::ProcessGroup(int rank, int world_size, size_t slot_floats, void* shared, size_t shared_bytes):
+    rank_(rank), world_size_(world_size), slot_floats_(slot_floats), shared_(shared),
+    shared_bytes_(shared_bytes), launcher_(0) {
+    result_ = slot(world_size_);
+}
+
+ProcessGroup::~ProcessGroup() {
+    for (pid_t child: children_) {
+        int status = 0;
+        waitpid(child, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            cout << "training process " << child << " exited abnormally!" << endl;
+        }
+    }
+    munmap(shared_, shared_bytes_);
+}
+
+float* ProcessGroup::slot(int rank) const {
+    char* base = static_cast<char*>(shared_) + header_bytes();
+    return reinterpret_cast<float*>(base) + rank * slot_floats_;
+}
+
+void ProcessGroup::barrier() {
+    SharedHeader* header = static_cast<SharedHeader*>(shared_);
+    int generation = header->generation.load();
+    if (header->arrived.fetch_add(1) + 1 == world_size_) {
+        header->arrived.store(0);
+        header->generation.fetch_add(1);
+        syscall(SYS_futex, &header->generation, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+        return;
+    }
+    timespec timeout {0, BARRIER_POLL_NS};
+    while (header->generation.load() == generation) {
+        syscall(SYS_futex, &header->generation, FUTEX_WAIT, generation, &timeout, nullptr, 0);
+        if (header->generation.load() == generation) {
+            check_peers();
+        }
+    }
+}
+
+// A rank that is gone never reaches the barrier again. The launcher reaps its
+// children and kills the rest of the group, the children notice the launcher
+// is gone when they are reparented.
+void ProcessGroup::check_peers() {
+    if (rank_ != 0) {
+        if (getppid() != launcher_) {
+            cout << "rank " << rank_ << " lost the launcher, exiting..." << endl;
+            exit(1);
+        }
+        return;
+    }
+    for (size_t r = 0; r < children_.size(); ++r) {
+        int status = 0;
+        if (waitpid(children_[r], &status, WNOHANG) != children_[r]) {
+            continue;
+        }
+        cout << "rank " << r + 1 << " exited while the group waits in a barrier!" << endl;
+        for (size_t other = 0; other < children_.size(); ++other) {
+            if (other != r) {
+                kill(children_[other], SIGKILL);
+            }
+        }
+        exit(1);
+    }
+}
+
+void ProcessGroup::all_reduce_mean(const vector<pair<float*, size_t>>& buffers) {
+    if (world_size_ == 1) {
+        return;
+    }
+    size_t total = total_count(buffers);
+    float scale = 1.0f / world_size_;
+    for (size_t start = 0; start < total; start += slot_floats_) {
+        size_t count = min(slot_floats_, total - start);
+        copy_flat(buffers, start, count, slot(rank_), true);
+        barrier();
+
+        size_t share = (count + world_size_ - 1) / world_size_;
+        size_t begin = min(count, rank_ * share);
+        size_t end = min(count, begin + share);
+        parallel_for(0, int(end - begin), [&](int first, int last) {
+            for (size_t j = begin + first; j < begin + last; ++j) {
+                float value = 0;
+                for (int r = 0; r < world_size_; ++r) {
+                    value += slot(r)[j];
+                }
+                result_[j] = value * scale;
+            }
+        }, ELEMENTWISE_GRAIN);
+        barrier();
+
+        copy_flat(buffers, start, count, result_, false);
+        barrier();
+    }
+}
+
+void ProcessGroup::broadcast(const vector<pair<float*, size_t>>& buffers, int root) {
+    if (world_size_ == 1) {
+        return;
+    }
+    size_t total = total_count(buffers);
+    for (size_t start = 0; start < total; start += slot_floats_) {
+        size_t count = min(slot_floats_, total - start);
+        if (rank_ == root) {
+            copy_flat(buffers, start, count, result_, true);
+        }
+        barrier();
+        if (rank_ != root) {
+            copy_flat(buffers, start, count, result_, false);
+        }
+        barrier();
+    }
+}
+
+} // namespace micronet
@@ -31,63 +31,71 @@ RegressionNet::RegressionNet(chunk_ptr (*graph_constructor)(const vector<chunk_p
 }
 
 void RegressionNet::fit(const map<string, data_t>& train_data, const map<string, data_t>& valid_data,
-                      int batch_size, int epochs, int verbose, bool shuffle) {
+                      int batch_size, int epochs, int verbose, bool shuffle,
+                      int accumulation_steps) {
     if (!net_initialized_) {
         cout << "net need to be initialized first!" << endl;
         exit(1);
     }
+    materialize_params();
     if (!optimizer_) {
         cout << "optimizer must be assigned!" << endl;
         exit(1);
     }
     for (int i = 0; i < inputs_.size()-1; ++i) {
-        if (train_data.find("input"+to_string(i)) == train_data.end()) {
+        if (!has_data(train_data, "input"+to_string(i))) {
             cout << "train input" << i << " data must be specified!" << endl;
             exit(1);
         }
-        if (valid_data.find("input"+to_string(i)) == valid_data.end()) {
+        if (!has_data(valid_data, "input"+to_string(i))) {
             cout << "valid input" << i << " data must be specified!" << endl;
             exit(1);
         }
     }
-    if (train_data.find("target") == train_data.end()) {
+    if (!has_data(train_data, "target")) {
         cout << "train target data must be specified!" << endl;
         exit(1);
     }
-    if (valid_data.find("target") == valid_data.end()) {
+    if (!has_data(valid_data, "target")) {
         cout << "valid target data must be specified!" << endl;
         exit(1);
     }
 
-    vector<data_t> train_data_vec, valid_data_vec;
+    if (hogwild_ && accumulation_steps > 1) {
+        cout << "hogwild training can not accumulate gradients!" << endl;
+        exit(1);
+    }
+
+    vector<string> train_keys;
     for (int i = 0; i < inputs_.size()-1; ++i) {
-        train_data_vec.push_back(train_data.at("input"+to_string(i)));
-        //valid_data_vec.push_back(valid_data.at("input"+to_string(i)));
+        train_keys.push_back("input"+to_string(i));
     }
-    train_data_vec.push_back(train_data.at("target"));
-    //valid_data_vec.push_back(valid_data.at("target"));
-    DataProvider train(train_data_vec, shuffle);
-    //DataProvider valid(valid_data_vec, false);
+    train_keys.push_back("target");
+    auto train = make_provider(train_data, train_keys, shuffle, true, true);
 
-    int train_num_examples = train.num_samples();
-    int train_num_fit_iters = train_num_examples * epochs / batch_size;
+    // every step accumulates accumulation_steps micro batches of batch_size
+    int step_size = batch_size * max(1, accumulation_steps);
+    int train_num_examples = train->num_samples();
+    int train_num_fit_iters = train_num_examples * epochs / step_size;
     optimizer_->total_iters_ = train_num_fit_iters;
 
-    int steps_per_epoch = train_num_examples / batch_size;
+    int steps_per_epoch = train_num_examples / step_size;
     for (int epo = 0; epo < epochs; ++epo) {
         cout << "==================== epoch: " << epo+1 << " starts =================" << endl;
         float train_loss = 0;
         Timer epoch_timer, step_timer;
-        for (int step = 0; step < steps_per_epoch; ++step) {
-            step_timer.resume();
-            train.load_batch(inputs_, batch_size);
-            forward(true); //cout << "forward " << step << endl;
-            backward(); //cout << "backward " << step << endl;
-            update(); //cout << "update " << step << endl;
-            float loss = key_chunks_["loss"]->const_data()[0];
-            train_loss += loss;
-            if (step % verbose == 0) {
-                print_loss(step, steps_per_epoch, loss, step_timer.elapsed());
+        if (hogwild_) {
+            train_loss = hogwild_epoch(*train, batch_size, steps_per_epoch)["loss"];
+        } else {
+            for (int step = 0; step < steps_per_epoch; ++step) {
+                step_timer.resume();
+                train_step(*train, batch_size, accumulation_steps); //cout << "train step " << step << endl;
+                checkpoint_step();
+                float loss = key_chunks_["loss"]->const_data()[0];
+                train_loss += loss;
+                if (step % verbose == 0) {
+                    print_loss(step, steps_per_epoch, loss, step_timer.elapsed());
+                }
             }
         }
         train_loss /= steps_per_epoch;
@@ -112,43 +120,44 @@ void RegressionNet::evaluate(const map<string, data_t>& data, int batch_size) {
         cout << "net need to be initialized first!" << endl;
         exit(1);
     }
+    materialize_params();
     for (int i = 0; i < inputs_.size()-1; ++i) {
-        if (data.find("input"+to_string(i)) == data.end()) {
+        if (!has_data(data, "input"+to_string(i))) {
             cout << "input" << i << " data must be specified!" << endl;
             exit(1);
         }
     }
-    if (data.find("target") == data.end()) {
+    if (!has_data(data, "target")) {
         cout << "target data must be specified!" << endl;
         exit(1);
     }
 
     Timer timer;
-    vector<data_t> eval_data_vec;
+    vector<string> eval_keys;
     for (int i = 0; i < inputs_.size()-1; ++i) {
-        eval_data_vec.push_back(data.at("input"+to_string(i)));
+        eval_keys.push_back("input"+to_string(i));
     }
-    eval_data_vec.push_back(data.at("target"));
-    DataProvider eval(eval_data_vec, false);
+    eval_keys.push_back("target");
+    auto eval = make_provider(data, eval_keys, false, false);
 
-    int eval_fit_steps = eval.num_samples() / batch_size;
-    int size_remain = eval.num_samples() % batch_size;
+    int eval_fit_steps = eval->num_samples() / batch_size;
+    int size_remain = eval->num_samples() % batch_size;
     float eval_loss = 0;
     for (int step = 0; step < eval_fit_steps; ++step) {
-        eval.load_batch(inputs_, batch_size);
+        eval->load_batch(inputs_, batch_size);
         //cout << step << endl;
         forward(false);
         float loss = key_chunks_["loss"]->const_data()[0];
         eval_loss += loss * batch_size;
     }
     if (size_remain) {
-        eval.load_batch(inputs_, size_remain);
+        eval->load_batch(inputs_, size_remain);
         //cout << step << endl;
         forward(false);
         float loss = key_chunks_["loss"]->const_data()[0];
         eval_loss += loss * size_remain;
     }
-    eval_loss /= eval.num_samples();
+    eval_loss /= eval->num_samples();
     cout << "eval loss: " << eval_loss << ", time used: " << fixed
          << setprecision(4) << timer.elapsed() << "s" << endl;
 }
@@ -158,8 +167,9 @@ data_t RegressionNet::inference(const map<string, data_t>& data, int batch_size)
         cout << "net need to be initialized first!" << endl;
         exit(1);
     }
+    materialize_params();
     for (int i = 0; i < inputs_.size()-1; ++i) {
-        if (data.find("input"+to_string(i)) == data.end()) {
+        if (!has_data(data, "input"+to_string(i))) {
             cout << "input" << i << " data must be specified!" << endl;
             exit(1);
         }
@@ -167,21 +177,21 @@ data_t RegressionNet::inference(const map<string, data_t>& data, int batch_size)
 
     Timer timer;
     vector<chunk_ptr> inputs;
-    vector<data_t> data_vec;
+    vector<string> infer_keys;
     for (int i = 0; i < inputs_.size()-1; ++i) {
-        data_vec.push_back(data.at("input"+to_string(i)));
+        infer_keys.push_back("input"+to_string(i));
         inputs.push_back(key_chunks_["input"+to_string(i)]);
     }
-    DataProvider infer(data_vec, false);
+    auto infer = make_provider(data, infer_keys, false, false);
     data_t data_inference;
 
-    int infer_steps = infer.num_samples() / batch_size;
-    int size_remain = infer.num_samples() % batch_size;
+    int infer_steps = infer->num_samples() / batch_size;
+    int size_remain = infer->num_samples() % batch_size;
     //cout << key_chunks_["output"]->count() << key_chunks_["output"]->num() << endl;
     int dim = key_chunks_["output"]->count() / key_chunks_["output"]->num();
     vector<int> target_shape = {key_chunks_["output"]->shape(1), key_chunks_["output"]->shape(2), key_chunks_["output"]->shape(3)};
     for (int step = 0; step < infer_steps; ++step) {
-        infer.load_batch(inputs, batch_size);
+        infer->load_batch(inputs, batch_size);
         key_chunks_["target"]->reshape(batch_size, target_shape[0], target_shape[1], target_shape[2]);
         forward(false);
         const float* output_data = key_chunks_["output"]->const_data();
@@ -191,7 +201,7 @@ data_t RegressionNet::inference(const map<string, data_t>& data, int batch_size)
         }
     }
     if (size_remain) {
-        infer.load_batch(inputs, size_remain);
+        infer->load_batch(inputs, size_remain);
         key_chunks_["target"]->reshape(size_remain, target_shape[0], target_shape[1], target_shape[2]);
         forward(false);
         const float* output_data = key_chunks_["output"]->const_data();
@@ -207,11 +217,7 @@ data_t RegressionNet::inference(const map<string, data_t>& data, int batch_size)
 
 void RegressionNet::forward(bool is_train, const string& layer_prefix) {
     //Timer t1;
-    for (auto layer = net_sequences_.begin(); layer != net_sequences_.end(); ++layer) {
-        Timer timer;
-        (*layer)->forward(is_train); //cout << (*layer)->layer_name_ << "forward" << endl;
-        layer_op_time_[(*layer)->layer_name_].first = timer.elapsed()*1000;
-    }
+    execute_forward(is_train);
     //if (iter_ % 100 == 0) {
     //    cout << "forward: " << t1.elapsed()*1000 << endl;
     //}
@@ -219,11 +225,7 @@ void RegressionNet::forward(bool is_train, const string& layer_prefix) {
 
 void RegressionNet::backward(const string& layer_prefix) {
     //Timer t1;
-    for (auto layer = net_sequences_.rbegin(); layer != net_sequences_.rend(); ++layer) {
-        Timer timer;
-        (*layer)->backward();
-        layer_op_time_[(*layer)->layer_name_].second = timer.elapsed()*1000;
-    }
+    execute_backward();
     //if (iter_ % 100 == 0) {
     //    cout << "backward: " << t1.elapsed()*1000 << endl;
     //}
@@ -232,6 +234,10 @@ void RegressionNet::backward(const string& layer_prefix) {
 void RegressionNet::update(const string& layer_prefix) {
     //Timer t1;
     iter_++;
+    if (param_arena_) {
+        step_arena();
+        return;
+    }
     for (auto& layer: net_sequences_) {
         Timer timer;
         for (auto& param: layer->params_) {
@@ -3,7 +3,6 @@
  * @auther yefajie
  * @data 2018/6/23
  **/
-#include <omp.h>
 #include "relu.h"
 
 namespace micronet {
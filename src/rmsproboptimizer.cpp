@@ -5,6 +5,10 @@
  **/
 #include "rmsproboptimizer.h"
 
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif // __SSE__
+
 namespace micronet {
 
 RMSProbOptimizer::RMSProbOptimizer(float learning_rate, vector<float> decay_locs, float decay_rate):
@@ -13,20 +17,42 @@ RMSProbOptimizer::RMSProbOptimizer(float learning_rate, vector<float> decay_locs
     flt_hps_["decay_rate"] = decay_rate;
 }
 
-void RMSProbOptimizer::optimize(const shared_ptr<Chunk>& param, int iter) {
-    float decay_loc = (float)iter / total_iters_;
-    int decay_index = find_if(decay_locs_.begin(), decay_locs_.end(),
-                              [&decay_loc](float loc) {return loc > decay_loc;}) - decay_locs_.begin();
-    float learning_rate = flt_hps_["learning_rate"] * pow(0.1, decay_index);
-    float decay_rate = flt_hps_["decay_rate"];
+void RMSProbOptimizer::prepare(const shared_ptr<Chunk>& param) {
+    state(accumulate_squared_gradient_, param);
+}
+
+RMSProbOptimizer::StepHps RMSProbOptimizer::resolve(int iter) {
+    return {decayed_learning_rate(iter), flt_hps_.at("decay_rate"), 0};
+}
+
+RMSProbOptimizer::StepBuffers RMSProbOptimizer::buffers(const shared_ptr<Chunk>& param) {
+    return {param->data(), param->const_diff(), {state(accumulate_squared_gradient_, param).data(), nullptr}};
+}
+
+void RMSProbOptimizer::update(const StepHps& hps, const StepBuffers& buffers, int begin, int end) {
+    float learning_rate = hps.learning_rate;
+    float decay_rate = hps.rate_1;
+    const float* diff = buffers.diff;
+    float* data = buffers.data;
+    float* acc_squared_grad = buffers.state[0];
 
-    if (accumulate_squared_gradient_.find(param.get()) == accumulate_squared_gradient_.end()) {
-        accumulate_squared_gradient_[param.get()] = Chunk(param->shape());
+    int i = begin;
+#ifdef __SSE__
+    __m128 v_learning_rate = _mm_set1_ps(learning_rate);
+    __m128 v_decay_rate = _mm_set1_ps(decay_rate);
+    __m128 v_keep_rate = _mm_set1_ps(1 - decay_rate);
+    __m128 v_epsilon = _mm_set1_ps(1e-7F);
+    __m128 v_sign = _mm_set1_ps(-0.0f);
+    for (; i + 4 <= end; i += 4) {
+        __m128 g = _mm_loadu_ps(diff + i);
+        __m128 acc = _mm_add_ps(_mm_mul_ps(v_decay_rate, _mm_loadu_ps(acc_squared_grad + i)),
+                                _mm_mul_ps(_mm_mul_ps(v_keep_rate, g), g));
+        _mm_storeu_ps(acc_squared_grad + i, acc);
+        __m128 rate = _mm_xor_ps(_mm_div_ps(v_learning_rate, _mm_sqrt_ps(_mm_add_ps(acc, v_epsilon))), v_sign);
+        _mm_storeu_ps(data + i, _mm_add_ps(_mm_loadu_ps(data + i), _mm_mul_ps(rate, g)));
     }
-    const float* diff = param->const_diff();
-    float* data = param->data();
-    float* acc_squared_grad = accumulate_squared_gradient_[param.get()].data();
-    for (int i = 0; i < param->count(); ++i) {
+#endif // __SSE__
+    for (; i < end; ++i) {
         acc_squared_grad[i]  = decay_rate * acc_squared_grad[i] + (1 - decay_rate) * diff[i] * diff[i];
         float update = -(learning_rate / sqrt(acc_squared_grad[i] + 1e-7F)) * diff[i];
         data[i] += update;
@@ -6,6 +6,10 @@
 #include <thread>
 #include "sgdoptimizer.h"
 
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif // __SSE__
+
 namespace micronet {
 
 SGDOptimizer::SGDOptimizer(float learning_rate, vector<float> decay_locs, float momentum):
@@ -14,21 +18,37 @@ SGDOptimizer::SGDOptimizer(float learning_rate, vector<float> decay_locs, float
     flt_hps_["momentum"] = momentum;
 }
 
-void SGDOptimizer::optimize(const shared_ptr<Chunk>& param, int iter) {
-    float decay_loc = (float)iter / total_iters_;
-    int decay_index = find_if(decay_locs_.begin(), decay_locs_.end(),
-                              [&decay_loc](float loc) {return loc > decay_loc;}) - decay_locs_.begin();
-    float learning_rate = flt_hps_["learning_rate"] * pow(0.1, decay_index);
-    float momentum = flt_hps_["momentum"];
+void SGDOptimizer::prepare(const shared_ptr<Chunk>& param) {
+    state(param_velocity_, param);
+}
 
-    if (param_velocity_.find(param.get()) == param_velocity_.end()) {
-        param_velocity_[param.get()] = Chunk(param->shape());
-    }
-    const float* diff = param->const_diff();
-    float* data = param->data();
-    float* velocity = param_velocity_[param.get()].data();
+SGDOptimizer::StepHps SGDOptimizer::resolve(int iter) {
+    return {decayed_learning_rate(iter), flt_hps_.at("momentum"), 0};
+}
 
-    for (int i = 0; i < param->count(); ++i) {
+SGDOptimizer::StepBuffers SGDOptimizer::buffers(const shared_ptr<Chunk>& param) {
+    return {param->data(), param->const_diff(), {state(param_velocity_, param).data(), nullptr}};
+}
+
+void SGDOptimizer::update(const StepHps& hps, const StepBuffers& buffers, int begin, int end) {
+    float learning_rate = hps.learning_rate;
+    float momentum = hps.rate_1;
+    const float* diff = buffers.diff;
+    float* data = buffers.data;
+    float* velocity = buffers.state[0];
+
+    int i = begin;
+#ifdef __SSE__
+    __m128 v_momentum = _mm_set1_ps(-momentum);
+    __m128 v_learning_rate = _mm_set1_ps(learning_rate);
+    for (; i + 4 <= end; i += 4) {
+        __m128 v = _mm_sub_ps(_mm_mul_ps(v_momentum, _mm_loadu_ps(velocity + i)),
+                              _mm_mul_ps(v_learning_rate, _mm_loadu_ps(diff + i)));
+        _mm_storeu_ps(velocity + i, v);
+        _mm_storeu_ps(data + i, _mm_add_ps(_mm_loadu_ps(data + i), v));
+    }
+#endif // __SSE__
+    for (; i < end; ++i) {
         velocity[i]  = - momentum * velocity[i] - learning_rate * diff[i];
         data[i] += velocity[i];
     }
@@ -1,6 +1,5 @@
 #include <cmath>
 #include <iostream>
-#include <omp.h>
 #include <string.h>
 #include "sigmoidloss.h"
 
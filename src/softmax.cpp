@@ -4,7 +4,6 @@
  * @data 2018/6/24
  **/
 #include <cmath>
-#include <omp.h>
 #include <string.h>
 #include "softmax.h"
 
@@ -5,9 +5,9 @@
  **/
 #include <cmath>
 #include <iostream>
-#include <omp.h>
 #include <string.h>
 #include "softmaxloss.h"
+#include "threadpool.h"
 
 namespace micronet {
 
@@ -95,17 +95,18 @@ void SoftmaxLoss::backward() {
     //for (int i = 0; i < logits->count(); ++i) {
     //    logits_diff[i] = prob_data[i];
     //}
-    #pragma omp parallel for
-    for (int n = 0; n < num; ++n) {
-        for (int h = 0; h < height; ++h) {
-            for (int w = 0; w < width; ++w) {
-                const int laindex = labels->offset(n, 0, h, w);
-                const int label_value = static_cast<int>(labels_data[laindex]);
-                const int loindex = logits->offset(n, label_value, h, w);
-                logits_diff[loindex] -= 1;
+    parallel_for(0, num, [&](int begin, int end) {
+        for (int n = begin; n < end; ++n) {
+            for (int h = 0; h < height; ++h) {
+                for (int w = 0; w < width; ++w) {
+                    const int laindex = labels->offset(n, 0, h, w);
+                    const int label_value = static_cast<int>(labels_data[laindex]);
+                    const int loindex = logits->offset(n, label_value, h, w);
+                    logits_diff[loindex] -= 1;
+                }
             }
         }
-    }
+    });
     for (int i = 0; i < logits->count(); ++i) {
         logits_diff[i] *= (loss_diff[0] / labels->count());
     }
@@ -0,0 +1,283 @@
+/**
+ * @file threadpool.cpp
+ * @auther yefajie
+ * @data 2026/10/19
+ **/
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <iostream>
+
+#include "threadpool.h"
+#include "allocator.h"
+
+namespace micronet {
+
+static thread_local int worker_index = -1;
+static atomic<bool> pool_started(false);
+static thread_local const ExecContext* current_context = nullptr;
+
+ExecContext::ExecContext(int num_threads, const vector<int>& cores):
+    num_threads_(max(1, num_threads)), pinned_(false), previous_(current_context) {
+    if (previous_ != nullptr) {
+        cores_ = previous_->cores_;
+    }
+    if (!cores.empty() && cores != cores_) {
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        for (int core: cores) {
+            CPU_SET(core, &cpu_set);
+        }
+        // best effort, the context still bounds the threads when pinning fails
+        pinned_ = pthread_getaffinity_np(pthread_self(), sizeof(previous_cpus_), &previous_cpus_) == 0 &&
+                  pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) == 0;
+        cores_ = cores;
+    }
+    current_context = this;
+}
+
+ExecContext::~ExecContext() {
+    if (pinned_) {
+        pthread_setaffinity_np(pthread_self(), sizeof(previous_cpus_), &previous_cpus_);
+    }
+    current_context = previous_;
+}
+
+int ExecContext::current_threads() {
+    if (current_context != nullptr) {
+        return current_context->num_threads_;
+    }
+    return ThreadPool::instance().num_threads();
+}
+
+vector<int> ExecContext::current_cores() {
+    return current_context != nullptr? current_context->cores_: vector<int>();
+}
+
+void TaskGroup::run(function<void()> task) {
+    if (pool_.workers_.empty()) {
+        task();
+        return;
+    }
+    pending_++;
+    pool_.submit({std::move(task), this});
+}
+
+// Helps with the group's queued tasks, sleeps once all of them are taken.
+// The threads running the rest wake it when the group finishes.
+void TaskGroup::wait() {
+    while (pending_.load() > 0) {
+        if (pool_.run_one(worker_index, this)) {
+            continue;
+        }
+        unique_lock<mutex> lock(pool_.sleep_lock_);
+        pool_.wake_.wait(lock, [this] {return pending_.load() == 0 || queued_.load() > 0;});
+    }
+}
+
+ThreadPool& ThreadPool::instance() {
+    static ThreadPool pool([] {
+        const char* env = getenv("MICRONET_NUM_THREADS");
+        int num_threads = env != nullptr? atoi(env): 0;
+        return num_threads > 0? num_threads: int(max(1u, thread::hardware_concurrency()));
+    }());
+    return pool;
+}
+
+ThreadPool::ThreadPool(int num_threads): queued_(0), next_queue_(0), stop_(false) {
+    pool_started = true;
+    start(num_threads);
+}
+
+ThreadPool::~ThreadPool() {
+    stop();
+}
+
+void ThreadPool::start(int num_threads) {
+    stop_ = false;
+    int num_workers = max(1, num_threads) - 1;
+    for (int i = 0; i < num_workers; ++i) {
+        queues_.emplace_back(new WorkQueue);
+    }
+    for (int i = 0; i < num_workers; ++i) {
+        workers_.emplace_back(&ThreadPool::worker_loop, this, i);
+        pin_worker(i);
+    }
+}
+
+void ThreadPool::stop() {
+    {
+        lock_guard<mutex> lock(sleep_lock_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto& worker: workers_) {
+        worker.join();
+    }
+    workers_.clear();
+    queues_.clear();
+}
+
+void ThreadPool::set_num_threads(int num_threads) {
+    if (num_threads == this->num_threads()) {
+        return;
+    }
+    stop();
+    start(num_threads);
+}
+
+void ThreadPool::set_affinity(const vector<int>& cores) {
+    cores_ = cores;
+    if (cores_.empty()) {
+        // round robin over the NUMA nodes so every node gets workers
+        vector<vector<int>> nodes = numa_node_cores();
+        for (int i = 0; int(cores_.size()) < int(thread::hardware_concurrency()); ++i) {
+            bool added = false;
+            for (const auto& node: nodes) {
+                if (i < int(node.size())) {
+                    cores_.push_back(node[i]);
+                    added = true;
+                }
+            }
+            if (!added) {
+                break;
+            }
+        }
+    }
+    for (int i = 0; i < int(workers_.size()); ++i) {
+        pin_worker(i);
+    }
+}
+
+void ThreadPool::pin_worker(int index) {
+    if (cores_.empty()) {
+        return;
+    }
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(cores_[index % cores_.size()], &cpu_set);
+    if (pthread_setaffinity_np(workers_[index].native_handle(), sizeof(cpu_set), &cpu_set) != 0) {
+        cout << "pin worker " << index << " to core " << cores_[index % cores_.size()] << " failed!" << endl;
+    }
+}
+
+void ThreadPool::submit(Task task) {
+    int index = worker_index >= 0? worker_index: int(next_queue_++ % queues_.size());
+    {
+        lock_guard<mutex> lock(queues_[index]->lock);
+        task.group->queued_++;
+        queues_[index]->tasks.push_back(std::move(task));
+        queued_++;
+    }
+    {
+        lock_guard<mutex> lock(sleep_lock_);
+    }
+    wake_.notify_one();
+}
+
+// Without a group this takes the newest or oldest task, with one it scans
+// for the first task of that group from the same end.
+bool ThreadPool::take_task(WorkQueue& queue, bool newest, TaskGroup* group, Task& task) {
+    lock_guard<mutex> lock(queue.lock);
+    int size = queue.tasks.size();
+    for (int i = 0; i < size; ++i) {
+        auto it = newest? queue.tasks.end() - 1 - i: queue.tasks.begin() + i;
+        if (group == nullptr || it->group == group) {
+            task = std::move(*it);
+            queue.tasks.erase(it);
+            task.group->queued_--;
+            queued_--;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ThreadPool::run_one(int self, TaskGroup* group) {
+    Task task;
+    bool found = self >= 0 && take_task(*queues_[self], true, group, task);
+    int num_queues = queues_.size();
+    for (int i = 1; !found && i <= num_queues; ++i) {
+        found = take_task(*queues_[(max(self, 0) + i) % num_queues], false, group, task);
+    }
+    if (!found) {
+        return false;
+    }
+    // tasks start from the whole pool, not the context of whoever helps
+    const ExecContext* context = current_context;
+    current_context = nullptr;
+    task.fn();
+    current_context = context;
+    // the group may be gone as soon as its count drops, only the pool is
+    // touched after that
+    if (--task.group->pending_ == 0) {
+        {
+            lock_guard<mutex> lock(sleep_lock_);
+        }
+        wake_.notify_all();
+    }
+    return true;
+}
+
+void ThreadPool::worker_loop(int index) {
+    worker_index = index;
+    while (true) {
+        if (run_one(index)) {
+            continue;
+        }
+        unique_lock<mutex> lock(sleep_lock_);
+        wake_.wait(lock, [this] {return stop_ || queued_.load() > 0;});
+        if (stop_ && queued_.load() == 0) {
+            return;
+        }
+    }
+}
+
+void ThreadPool::parallel_for(int begin, int end, const function<void(int, int)>& fn, int grain) {
+    int n = end - begin;
+    if (n <= 0) {
+        return;
+    }
+    int budget = ExecContext::current_threads();
+    int num_chunks = min((n + grain - 1) / max(grain, 1), 4 * budget);
+    if (budget <= 1 || num_chunks <= 1 || workers_.empty()) {
+        fn(begin, end);
+        return;
+    }
+    int step = (n + num_chunks - 1) / num_chunks;
+    num_chunks = (n + step - 1) / step;
+    // the caller and at most budget - 1 runners take chunks off a shared
+    // counter, so no more than budget threads run the loop at once whichever
+    // workers pick the runners up, and they keep to the caller's cores
+    int num_runners = min(budget, num_chunks);
+    int sub_team = max(1, budget / num_runners);
+    atomic<int> next_chunk(0);
+    vector<int> cores = ExecContext::current_cores();
+    function<void()> run_chunks = [&fn, &next_chunk, &cores, begin, end, step, num_chunks, sub_team] {
+        ExecContext context(sub_team, cores);
+        for (int chunk = next_chunk++; chunk < num_chunks; chunk = next_chunk++) {
+            int chunk_begin = begin + chunk * step;
+            fn(chunk_begin, min(chunk_begin + step, end));
+        }
+    };
+    TaskGroup group(*this);
+    for (int r = 1; r < num_runners; ++r) {
+        group.run(run_chunks);
+    }
+    run_chunks();
+    group.wait();
+}
+
+void set_num_threads(int num_threads) {
+    ThreadPool::instance().set_num_threads(num_threads);
+}
+
+int get_num_threads() {
+    return ThreadPool::instance().num_threads();
+}
+
+bool thread_pool_started() {
+    return pool_started;
+}
+
+} // namespace micronet
@@ -0,0 +1,139 @@
+/**
+ * @file transform.cpp
+ * @auther yefajie
+ * @data 2026/10/19
+ **/
+#include <random>
+#include <iostream>
+#include <algorithm>
+#include <string.h>
+
+#include "transform.h"
+#include "math_func.h"
+
+namespace micronet {
+
+RandomCrop::RandomCrop(int crop_h, int crop_w, int pad):
+    Transform("RandomCrop"), crop_h_(crop_h), crop_w_(crop_w), pad_(pad) {
+    if (crop_h <= 0 || crop_w <= 0 || pad < 0) {
+        cout << "RandomCrop crop must be positive and pad non-negative..." << endl;
+        exit(1);
+    }
+}
+
+vector<int> RandomCrop::shape_inference(const vector<int>& in_shape) {
+    if (crop_h_ > in_shape[1] + 2 * pad_ || crop_w_ > in_shape[2] + 2 * pad_) {
+        cout << "RandomCrop " << crop_h_ << "x" << crop_w_ << " is larger than the padded "
+             << in_shape[1] << "x" << in_shape[2] << " input..." << endl;
+        exit(1);
+    }
+    return {in_shape[0], crop_h_, crop_w_};
+}
+
+void RandomCrop::apply(const float* in, const vector<int>& in_shape, float* out,
+                       bool augment, unsigned seed) {
+    int channels = in_shape[0], height = in_shape[1], width = in_shape[2];
+    int range_h = height + 2 * pad_ - crop_h_;
+    int range_w = width + 2 * pad_ - crop_w_;
+    int off_h = range_h / 2, off_w = range_w / 2;
+    if (augment) {
+        std::default_random_engine generator(seed);
+        off_h = std::uniform_int_distribution<int>(0, range_h)(generator);
+        off_w = std::uniform_int_distribution<int>(0, range_w)(generator);
+    }
+    for (int c = 0; c < channels; ++c) {
+        for (int h = 0; h < crop_h_; ++h) {
+            int ih = h + off_h - pad_;
+            for (int w = 0; w < crop_w_; ++w) {
+                int iw = w + off_w - pad_;
+                bool inside = ih >= 0 && ih < height && iw >= 0 && iw < width;
+                out[(c * crop_h_ + h) * crop_w_ + w] = inside? in[(c * height + ih) * width + iw]: 0.0f;
+            }
+        }
+    }
+}
+
+RandomFlip::RandomFlip(float prob): Transform("RandomFlip"), prob_(prob) {
+}
+
+vector<int> RandomFlip::shape_inference(const vector<int>& in_shape) {
+    return in_shape;
+}
+
+void RandomFlip::apply(const float* in, const vector<int>& in_shape, float* out,
+                       bool augment, unsigned seed) {
+    int count = in_shape[0] * in_shape[1] * in_shape[2];
+    bool flip = false;
+    if (augment) {
+        std::default_random_engine generator(seed);
+        flip = std::uniform_real_distribution<float>(0.0f, 1.0f)(generator) < prob_;
+    }
+    if (!flip) {
+        memcpy(out, in, count*sizeof(float));
+        return;
+    }
+    int width = in_shape[2];
+    for (int row = 0; row < in_shape[0] * in_shape[1]; ++row) {
+        const float* in_row = in + row * width;
+        float* out_row = out + row * width;
+        for (int w = 0; w < width; ++w) {
+            out_row[w] = in_row[width - 1 - w];
+        }
+    }
+}
+
+Resize::Resize(float h_rate, float w_rate): Transform("Resize"), h_rate_(h_rate), w_rate_(w_rate) {
+}
+
+vector<int> Resize::shape_inference(const vector<int>& in_shape) {
+    return {in_shape[0], int(in_shape[1] * h_rate_), int(in_shape[2] * w_rate_)};
+}
+
+void Resize::apply(const float* in, const vector<int>& in_shape, float* out,
+                   bool augment, unsigned seed) {
+    bilinear_interpolation(in_shape[1], in_shape[2], in_shape[0], in, h_rate_, w_rate_, out);
+}
+
+vector<int> RGBToL::shape_inference(const vector<int>& in_shape) {
+    if (in_shape[0] != 3) {
+        cout << "RGBToL needs 3 channels, the input has " << in_shape[0] << "..." << endl;
+        exit(1);
+    }
+    return {1, in_shape[1], in_shape[2]};
+}
+
+void RGBToL::apply(const float* in, const vector<int>& in_shape, float* out,
+                   bool augment, unsigned seed) {
+    int img_size = in_shape[1] * in_shape[2];
+    const float* r = in;
+    const float* g = in + img_size;
+    const float* b = in + img_size + img_size;
+    for (int i = 0; i < img_size; ++i) {
+        float max_pixel = max(max(r[i], g[i]), b[i]);
+        float min_pixel = min(min(r[i], g[i]), b[i]);
+        out[i] = (max_pixel + min_pixel) / 2.0f;
+    }
+}
+
+LowResolution::LowResolution(float factor): Transform("LowResolution"), factor_(factor) {
+}
+
+vector<int> LowResolution::shape_inference(const vector<int>& in_shape) {
+    float rate = 1 / factor_;
+    int low_h = int(in_shape[1] * factor_);
+    int low_w = int(in_shape[2] * factor_);
+    return {in_shape[0], int(low_h * rate), int(low_w * rate)};
+}
+
+void LowResolution::apply(const float* in, const vector<int>& in_shape, float* out,
+                          bool augment, unsigned seed) {
+    thread_local vector<float> down_sampled;
+    int low_h = int(in_shape[1] * factor_);
+    int low_w = int(in_shape[2] * factor_);
+    down_sampled.resize(in_shape[0] * low_h * low_w);
+    bilinear_interpolation(in_shape[1], in_shape[2], in_shape[0], in, factor_, factor_, down_sampled.data());
+    float rate = 1 / factor_;
+    bilinear_interpolation(low_h, low_w, in_shape[0], down_sampled.data(), rate, rate, out);
+}
+
+} // namespace micronet
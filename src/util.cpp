@@ -3,12 +3,14 @@
  * @auther yefajie
  * @data 2018/6/22
  **/
-#include <omp.h>
+#include <string.h>
 
 #include "adagradoptimizer.h"
 #include "adamoptimizer.h"
 #include "rmsproboptimizer.h"
 #include "sgdoptimizer.h"
+#include "larsoptimizer.h"
+#include "lamboptimizer.h"
 #include "accuracy.h"
 #include "activation.h"
 #include "add.h"
@@ -22,6 +24,7 @@
 #include "softmaxloss.h"
 #include "sigmoidloss.h"
 #include "util.h"
+#include "threadpool.h"
 #include "deconvolution.h"
 #include "l2loss.h"
 #include "croppingimage.h"
@@ -31,6 +34,7 @@
 #include "reshape.h"
 #include "pixelshuffle.h"
 #include "instancenormalization.h"
+#include "transform.h"
 
 namespace micronet {
 
@@ -46,171 +50,189 @@ int ReverseInt(int i)
     return((int)ch1 << 24) + ((int)ch2 << 16) + ((int)ch3 << 8) + ch4;
 }
 
+static bool read_file(const string& filename, vector<unsigned char>& buffer) {
+    ifstream file(filename, ios::binary | ios::ate);
+    if (!file.is_open()) {
+        return false;
+    }
+    streamsize size = file.tellg();
+    file.seekg(0, ios::beg);
+    buffer.resize(size);
+    return bool(file.read((char*)buffer.data(), size));
+}
+
+static int read_header_int(const unsigned char* buffer) {
+    int value = 0;
+    memcpy(&value, buffer, sizeof(value));
+    return ReverseInt(value);
+}
+
+static void decode_pixels(const unsigned char* pixels, int n, float* image) {
+    for (int i = 0; i < n; ++i) {
+        image[i] = (float)pixels[i];
+    }
+}
+
 void read_mnist_lables(const string& filename, vector<vector<float>>& labels) {
-    ifstream file(filename, ios::binary);
-    if (file.is_open())
+    vector<unsigned char> buffer;
+    if (read_file(filename, buffer))
     {
-        int magic_number = 0;
-        int number_of_images = 0;
-        file.read((char*)&magic_number, sizeof(magic_number));
-        file.read((char*)&number_of_images, sizeof(number_of_images));
-        magic_number = ReverseInt(magic_number);
-        number_of_images = ReverseInt(number_of_images);
+        if (buffer.size() < 8) {
+            cout << filename << " is too short for a mnist label header!" << endl;
+            exit(1);
+        }
+        int magic_number = read_header_int(buffer.data());
+        int number_of_images = read_header_int(buffer.data() + 4);
         cout << "magic number = " << magic_number << endl;
         cout << "number of images = " << number_of_images << endl;
+        if (number_of_images < 0 || 8 + size_t(number_of_images) > buffer.size()) {
+            cout << filename << " holds fewer labels than its header says!" << endl;
+            exit(1);
+        }
 
+        const unsigned char* label = buffer.data() + 8;
+        int offset = labels.size();
+        labels.resize(offset + number_of_images);
         for (int i = 0; i < number_of_images; i++)
         {
-            unsigned char label = 0;
-            file.read((char*)&label, sizeof(label));
-            labels.push_back({(float)label});
+            labels[offset + i] = {(float)label[i]};
         }
     }
 }
 
 void read_mnist_images(const string& filename, vector<vector<float>>& images) {
-    ifstream file(filename, ios::binary);
-    if (file.is_open())
+    vector<unsigned char> buffer;
+    if (read_file(filename, buffer))
     {
-        int magic_number = 0;
-        int number_of_images = 0;
-        int n_rows = 0;
-        int n_cols = 0;
-        file.read((char*)&magic_number, sizeof(magic_number));
-        file.read((char*)&number_of_images, sizeof(number_of_images));
-        file.read((char*)&n_rows, sizeof(n_rows));
-        file.read((char*)&n_cols, sizeof(n_cols));
-        magic_number = ReverseInt(magic_number);
-        number_of_images = ReverseInt(number_of_images);
-        n_rows = ReverseInt(n_rows);
-        n_cols = ReverseInt(n_cols);
+        if (buffer.size() < 16) {
+            cout << filename << " is too short for a mnist image header!" << endl;
+            exit(1);
+        }
+        int magic_number = read_header_int(buffer.data());
+        int number_of_images = read_header_int(buffer.data() + 4);
+        int n_rows = read_header_int(buffer.data() + 8);
+        int n_cols = read_header_int(buffer.data() + 12);
 
         cout << "magic number = " << magic_number << endl;
         cout << "number of images = " << number_of_images << endl;
         cout << "rows = " << n_rows << endl;
         cout << "cols = " << n_cols << endl;
+        if (number_of_images < 0 || n_rows < 0 || n_cols < 0 ||
+            16 + size_t(number_of_images) * size_t(n_rows) * size_t(n_cols) > buffer.size()) {
+            cout << filename << " holds fewer pixels than its header says!" << endl;
+            exit(1);
+        }
 
+        const unsigned char* pixels = buffer.data() + 16;
+        int dim = n_rows * n_cols;
+        int offset = images.size();
+        images.resize(offset + number_of_images);
         for (int i = 0; i < number_of_images; i++)
         {
-            vector<float> tp;
-            for (int r = 0; r < n_rows; r++)
-            {
-                for (int c = 0; c < n_cols; c++)
-                {
-                    unsigned char image = 0;
-                    file.read((char*)&image, sizeof(image));
-                    tp.push_back((float)image);
-                }
-            }
-            images.push_back(tp);
+            images[offset + i].resize(dim);
+            decode_pixels(pixels + i * dim, dim, images[offset + i].data());
         }
     }
 }
 
-void read_cifar10_images(const string& dirname, vector<vector<float>>& images, bool train) {
-    if (!train) {
-        string filename = dirname;
-        ifstream ifs(filename, ios::binary);
-        unsigned char pixel;
-        for (int n = 0; n < 10000; ++n) {
-            ifs.read((char*)&pixel, sizeof(pixel));
-            vector<float> image;
-            for (int j = 0; j < 1024*3; ++j) {
-                ifs.read((char*)&pixel, sizeof(pixel));
-                image.push_back((float)pixel);
-            }
-            images.push_back(image);
-        }
+// Reads one cifar binary shard of records laid out as label_bytes labels followed by
+// 3x32x32 pixels, keeping the records whose first label equals category (all when -1).
+void read_cifar_shard(const string& filename, int label_bytes, int category, vector<vector<float>>& images) {
+    vector<unsigned char> buffer;
+    if (!read_file(filename, buffer)) {
+        cout << "can not read " << filename << endl;
         return;
     }
-    for (int i = 1; i <= 4; ++i) {
-        string filename = dirname + "/data_batch_" + to_string(i) + ".bin";
-        ifstream ifs(filename, ios::binary);
-        unsigned char pixel;
-        for (int n = 0; n < 10000; ++n) {
-            ifs.read((char*)&pixel, sizeof(pixel));
-            vector<float> image;
-            for (int j = 0; j < 1024*3; ++j) {
-                ifs.read((char*)&pixel, sizeof(pixel));
-                image.push_back((float)pixel);
-            }
-            images.push_back(image);
+    const int dim = 1024*3;
+    const int record_size = label_bytes + dim;
+    if (buffer.size() % record_size != 0) {
+        cout << filename << " is not a whole number of " << record_size << " byte cifar records!" << endl;
+        exit(1);
+    }
+    int num_records = buffer.size() / record_size;
+
+    int num_kept = num_records;
+    if (category >= 0) {
+        num_kept = 0;
+        for (int n = 0; n < num_records; ++n) {
+            num_kept += buffer[n * record_size] == category;
+        }
+    }
+    images.resize(num_kept);
+    int kept = 0;
+    for (int n = 0; n < num_records; ++n) {
+        const unsigned char* record = buffer.data() + n * record_size;
+        if (category >= 0 && record[0] != category) {
+            continue;
         }
+        images[kept].resize(dim);
+        decode_pixels(record + label_bytes, dim, images[kept].data());
+        kept++;
     }
 }
 
-void read_cifar10_gan_imgs(const string& dirname, vector<vector<float>>& images, int category) {
-    string filename = dirname + "/test_batch.bin";
-    ifstream ifs(filename, ios::binary);
-    unsigned char pixel, type;
-    for (int n = 0; n < 10000; ++n) {
-        ifs.read((char*)&type, sizeof(type));
-        vector<float> image;
-        for (int j = 0; j < 1024*3; ++j) {
-            ifs.read((char*)&pixel, sizeof(pixel));
-            image.push_back((float)pixel);
+void read_cifar_shards(const vector<string>& filenames, int label_bytes, int category,
+                       vector<vector<float>>& images) {
+    vector<vector<vector<float>>> shards(filenames.size());
+    parallel_for(0, filenames.size(), [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            read_cifar_shard(filenames[i], label_bytes, category, shards[i]);
         }
-        if (type == category) {
-            images.push_back(image);
+    });
+    size_t total = images.size();
+    for (const auto& shard: shards) {
+        total += shard.size();
+    }
+    images.reserve(total);
+    for (auto& shard: shards) {
+        for (auto& image: shard) {
+            images.push_back(std::move(image));
         }
     }
+}
+
+void read_cifar10_images(const string& dirname, vector<vector<float>>& images, bool train) {
+    if (!train) {
+        read_cifar_shards({dirname}, 1, -1, images);
+        return;
+    }
+    vector<string> filenames;
+    for (int i = 1; i <= 4; ++i) {
+        filenames.push_back(dirname + "/data_batch_" + to_string(i) + ".bin");
+    }
+    read_cifar_shards(filenames, 1, -1, images);
+}
+
+void read_cifar10_gan_imgs(const string& dirname, vector<vector<float>>& images, int category) {
+    vector<string> filenames {dirname + "/test_batch.bin"};
     for (int i = 1; i <= 5; ++i) {
-        string filename = dirname + "/data_batch_" + to_string(i) + ".bin";
-        ifstream ifs(filename, ios::binary);
-        unsigned char pixel, type;
-        for (int n = 0; n < 10000; ++n) {
-            ifs.read((char*)&type, sizeof(type));
-            vector<float> image;
-            for (int j = 0; j < 1024*3; ++j) {
-                ifs.read((char*)&pixel, sizeof(pixel));
-                image.push_back((float)pixel);
-            }
-            if (type == category) {
-                images.push_back(image);
-            }
-        }
+        filenames.push_back(dirname + "/data_batch_" + to_string(i) + ".bin");
     }
+    read_cifar_shards(filenames, 1, category, images);
 }
 
 void read_cifar100_images(const string& dirname, vector<vector<float>>& images) {
-    string filename = dirname + "/train.bin";
-    ifstream ifs(filename, ios::binary);
-    unsigned char pixel;
-    for (int n = 0; n < 50000; ++n) {
-        ifs.read((char*)&pixel, sizeof(pixel));
-        ifs.read((char*)&pixel, sizeof(pixel));
-        vector<float> image;
-        for (int j = 0; j < 1024*3; ++j) {
-            ifs.read((char*)&pixel, sizeof(pixel));
-            image.push_back((float)pixel);
-        }
-        images.push_back(image);
-    }
+    read_cifar_shards({dirname + "/train.bin"}, 2, -1, images);
 }
 
 void cal_low_imgs(const vector<vector<float>>& images, vector<vector<float>>& low_images, float factor) {
+    LowResolution low_resolution(factor);
+    vector<int> shape {3, 32, 32};
+    vector<int> low_shape = low_resolution.shape_inference(shape);
     for (int n = 0; n < images.size(); ++n) {
-        float rate = factor;
-        vector<float> down_sampled_img(int(3*32*rate*32*rate));
-        bilinear_interpolation(32, 32, 3, images[n].data(), rate, rate, down_sampled_img.data());
-        rate = 1 / factor;
-        vector<float> up_sampled_img(int(3*32*factor*rate*32*factor*rate));
-        bilinear_interpolation(int(32*factor), int(32*factor), 3, down_sampled_img.data(), rate, rate, up_sampled_img.data());
+        vector<float> up_sampled_img(low_shape[0]*low_shape[1]*low_shape[2]);
+        low_resolution.apply(images[n].data(), shape, up_sampled_img.data(), false, 0);
         low_images.push_back(up_sampled_img);
     }
 
 }
 
 void cal_L_component_from_RGB(const vector<vector<float>>& rgb_images, vector<vector<float>>& l_images) {
-    int img_size = rgb_images[0].size() / 3;
+    RGBToL rgb_to_l;
+    vector<int> shape {3, 1, int(rgb_images[0].size()) / 3};
     for (int n = 0; n < rgb_images.size(); ++n) {
-        vector<float> l_img;
-        float max_pixel = 255, min_pixel = 0;
-        for (int i = 0; i < img_size; ++i) {
-            max_pixel = max(max(rgb_images[n][i], rgb_images[n][i+img_size]), rgb_images[n][i+img_size+img_size]);
-            min_pixel = min(min(rgb_images[n][i], rgb_images[n][i+img_size]), rgb_images[n][i+img_size+img_size]);
-            l_img.push_back((max_pixel+min_pixel)/2.0);
-        }
+        vector<float> l_img(shape[2]);
+        rgb_to_l.apply(rgb_images[n].data(), shape, l_img.data(), false, 0);
         l_images.push_back(l_img);
     }
 }
@@ -229,25 +251,26 @@ float img2col_get_pixel(const float* data_im, int height, int width, int channel
 
 void img2col(const float* data_im, int channels,  int height,  int width, int ksize_h,
             int ksize_w, int pad_h, int pad_w, int stride_h, int stride_w, float* data_col) {
-    int c,h,w;
     int height_col = (height + 2*pad_h - ksize_h) / stride_h + 1;
     int width_col = (width + 2*pad_w - ksize_w) / stride_w + 1;
 
-    int channels_col = channels * ksize_h * ksize_w;
-    for (c = 0; c < channels_col; ++c) {
-        int w_offset = c % ksize_w;
-        int h_offset = (c / ksize_w) % ksize_h;
-        int c_im = c / ksize_h / ksize_w;
-        for (h = 0; h < height_col; ++h) {
-            for (w = 0; w < width_col; ++w) {
-                int im_row = h_offset + h * stride_h;
-                int im_col = w_offset + w * stride_w;
-                int col_index = (c * height_col + h) * width_col + w;
-                data_col[col_index] = img2col_get_pixel(data_im, height, width, channels,
-                        im_row, im_col, c_im, pad_h, pad_w);
+    // each image channel owns ksize_h*ksize_w rows of data_col
+    parallel_for(0, channels, [&](int begin, int end) {
+        for (int c = begin * ksize_h * ksize_w; c < end * ksize_h * ksize_w; ++c) {
+            int w_offset = c % ksize_w;
+            int h_offset = (c / ksize_w) % ksize_h;
+            int c_im = c / ksize_h / ksize_w;
+            for (int h = 0; h < height_col; ++h) {
+                for (int w = 0; w < width_col; ++w) {
+                    int im_row = h_offset + h * stride_h;
+                    int im_col = w_offset + w * stride_w;
+                    int col_index = (c * height_col + h) * width_col + w;
+                    data_col[col_index] = img2col_get_pixel(data_im, height, width, channels,
+                            im_row, im_col, c_im, pad_h, pad_w);
+                }
             }
         }
-    }
+    }, plane_grain(ksize_h * ksize_w * height_col * width_col));
 }
 
 void col2im_add_pixel(float *im, int height, int width, int channels,
@@ -262,32 +285,37 @@ void col2im_add_pixel(float *im, int height, int width, int channels,
 
 void col2img(const float* data_col, int channels, int height, int width, int ksize_h,
              int ksize_w, int pad_h, int pad_w, int stride_h, int stride_w, float* data_im) {
-    int c,h,w;
     int height_col = (height + 2*pad_h - ksize_h) / stride_h + 1;
     int width_col = (width + 2*pad_w - ksize_w) / stride_w + 1;
 
-    int channels_col = channels * ksize_h * ksize_w;
-    for (c = 0; c < channels_col; ++c) {
-        int w_offset = c % ksize_w;
-        int h_offset = (c / ksize_w) % ksize_h;
-        int c_im = c / ksize_h / ksize_w;
-        for (h = 0; h < height_col; ++h) {
-            for (w = 0; w < width_col; ++w) {
-                int im_row = h_offset + h * stride_h;
-                int im_col = w_offset + w * stride_w;
-                int col_index = (c * height_col + h) * width_col + w;
-                double val = data_col[col_index];
-                col2im_add_pixel(data_im, height, width, channels,
-                        im_row, im_col, c_im, pad_h, pad_w, val);
+    // each image channel owns ksize_h*ksize_w rows of data_col
+    parallel_for(0, channels, [&](int begin, int end) {
+        for (int c = begin * ksize_h * ksize_w; c < end * ksize_h * ksize_w; ++c) {
+            int w_offset = c % ksize_w;
+            int h_offset = (c / ksize_w) % ksize_h;
+            int c_im = c / ksize_h / ksize_w;
+            for (int h = 0; h < height_col; ++h) {
+                for (int w = 0; w < width_col; ++w) {
+                    int im_row = h_offset + h * stride_h;
+                    int im_col = w_offset + w * stride_w;
+                    int col_index = (c * height_col + h) * width_col + w;
+                    double val = data_col[col_index];
+                    col2im_add_pixel(data_im, height, width, channels,
+                            im_row, im_col, c_im, pad_h, pad_w, val);
+                }
             }
         }
-    }
+    }, plane_grain(ksize_h * ksize_w * height_col * width_col));
+}
+
+int next_seed() {
+    global_seed += 1001;
+    return int(global_seed & 0x7fffffff);
 }
 
 void normal_random_init(int n, float* x, float mean, float stddev, int seed) {
     if (seed == -1) {
-        global_seed += 1001;
-        seed = global_seed;
+        seed = next_seed();
     }
     std::default_random_engine generator(seed);
     std::normal_distribution<float> distribution(mean, stddev);
@@ -305,8 +333,7 @@ void normal_random_init(int n, float* x, float mean, float stddev, int seed) {
 
 void uniform_random_init(int n, float* x, float lower, float upper, int seed) {
     if (seed == -1) {
-        global_seed += 1001;
-        seed = global_seed;
+        seed = next_seed();
     }
     std::default_random_engine generator(seed);
     std::uniform_real_distribution<float> distribution(lower, upper);
@@ -332,6 +359,10 @@ shared_ptr<Optimizer> parse_optimizer(const json& j_optimizer) {
         optimizer = make_shared<RMSProbOptimizer>();
     } else if (optimizer_type == "SGD") {
         optimizer = make_shared<SGDOptimizer>();
+    } else if (optimizer_type == "LARS") {
+        optimizer = make_shared<LARSOptimizer>();
+    } else if (optimizer_type == "LAMB") {
+        optimizer = make_shared<LAMBOptimizer>();
     }
     optimizer->optimizer_type_ = optimizer_type;
     optimizer->decay_locs_ = j_optimizer["decay_locs"].get<vector<float>>();
@@ -349,25 +380,53 @@ shared_ptr<Chunk> parse_chunk(const json& j_chunk) {
     return chunk;
 }
 
-shared_ptr<Chunk> parse_param(const json& j_param, map<string, shared_ptr<Chunk>>& params) {
+shared_ptr<Chunk> parse_param(const json& j_param, map<string, shared_ptr<Chunk>>& params,
+                              const BlobSource* blobs) {
     auto param_id = j_param["param_id"].get<string>();
     if (params.find(param_id) != params.end()) {
         return params[param_id];
     }
     auto shape = j_param["shape"].get<vector<int>>();
-    auto data = j_param["data"].get<vector<float>>();
     shared_ptr<Chunk> param = make_shared<Chunk>(shape);
-    //param->data_ = make_shared<vector<float>>(data);
-    param->data_ = new float[data.size()];
-    std::copy(data.begin(), data.end(), param->data_);
-    param->trainable_ = j_param["trainable"].get<bool>();
+    auto j_data = j_param.find("data");
+    if (j_data != j_param.end()) {
+        if (!j_data->is_array() || j_data->size() != size_t(param->count())) {
+            cout << "param " << param_id << " has " << j_data->size() << " values, its shape needs "
+                 << param->count() << "!" << endl;
+            exit(1);
+        }
+        float* data = param->data();
+        for (const json& value: *j_data) {
+            *data++ = value.get<float>();
+        }
+    } else if (blobs != nullptr) {
+        size_t offset = j_param["offset"].get<size_t>();
+        bool fp16 = j_param["dtype"].get<string>() == "fp16";
+        size_t bytes = size_t(param->count()) * (fp16? sizeof(uint16_t): sizeof(float));
+        if (offset > blobs->size || bytes > blobs->size - offset) {
+            cout << "param " << param_id << " blob is out of the model file!" << endl;
+            exit(1);
+        }
+        const char* blob = blobs->base + offset;
+        if (fp16) {
+            const uint16_t* halfs = reinterpret_cast<const uint16_t*>(blob);
+            float* data = param->data();
+            for (int i = 0; i < param->count(); ++i) {
+                data[i] = half_to_float(halfs[i]);
+            }
+        } else {
+            param->share_data(reinterpret_cast<float*>(const_cast<char*>(blob)), blobs->holder);
+        }
+    }
+    param->set_trainable(j_param["trainable"].get<bool>());
 
     params[param_id] = param;
 
     return param;
 }
 
-shared_ptr<Layer> parse_layer(const json& j_layer, map<string, shared_ptr<Chunk>>& params) {
+shared_ptr<Layer> parse_layer(const json& j_layer, map<string, shared_ptr<Chunk>>& params,
+                              const BlobSource* blobs) {
     string layer_type = j_layer["layer_type"].get<string>();
     shared_ptr<Layer> layer;
     if (layer_type == "Accuracy") {
@@ -422,14 +481,14 @@ shared_ptr<Layer> parse_layer(const json& j_layer, map<string, shared_ptr<Chunk>
     layer->int_hps_ = j_layer["int_hps"].get<map<string, int>>();
 
     for (const json& j_param: j_layer["params"]) {
-        shared_ptr<Chunk> param = parse_param(j_param, params);
+        shared_ptr<Chunk> param = parse_param(j_param, params, blobs);
         layer->params_.push_back(param);
     }
 
     return layer;
 }
 
-void to_json(json& j_net, Net* net) {
+void to_json(json& j_net, Net* net, bool with_data) {
     j_net["net_name"] = net->net_name_;
     j_net["iter"] = net->iter_;
     j_net["optimizer"]["optimizer_type"] = net->optimizer_->optimizer_type_;
@@ -438,6 +497,12 @@ void to_json(json& j_net, Net* net) {
     j_net["optimizer"]["flt_hps"] = net->optimizer_->flt_hps_;
     j_net["optimizer"]["int_hps"] = net->optimizer_->int_hps_;
 
+    for (const auto& layer_threads: net->layer_threads_) {
+        for (const auto& batch_threads: layer_threads.second) {
+            j_net["tuning"][layer_threads.first][to_string(batch_threads.first)] = batch_threads.second;
+        }
+    }
+
     j_net["inputs"] = {};
     for (const auto& chunk: net->inputs_) {
         j_net["inputs"].push_back(to_string(long(chunk.get())));
@@ -465,7 +530,9 @@ void to_json(json& j_net, Net* net) {
             j_param["param_id"] = to_string(long(param.get()));
             j_param["shape"] = param->shape();
             j_param["trainable"] = param->trainable();
-            j_param["data"] = vector<float>(param->const_data(), param->const_data()+param->count());;
+            if (with_data) {
+                j_param["data"] = vector<float>(param->const_data(), param->const_data()+param->count());
+            }
             j_layer["params"].push_back(j_param);
         }
         j_layer["chunks_in"] = {};
@@ -486,17 +553,27 @@ void to_json(json& j_net, Net* net) {
     }
 }
 
-void from_json(const json& j_net, Net* net) {
+void from_json(const json& j_net, Net* net, const BlobSource* blobs) {
     net->net_name_ = j_net["net_name"].get<string>();
     net->iter_ = j_net["iter"].get<int>();
     net->optimizer_ = parse_optimizer(j_net["optimizer"]);
+    net->layer_threads_.clear();
+    auto j_tuning = j_net.find("tuning");
+    if (j_tuning != j_net.end()) {
+        for (const auto& j_layer_threads: j_tuning->items()) {
+            for (const auto& j_batch_threads: j_layer_threads.value().items()) {
+                int batch_size = stoi(j_batch_threads.key());
+                net->layer_threads_[j_layer_threads.key()][batch_size] = j_batch_threads.value().get<int>();
+            }
+        }
+    }
 
     map<string, shared_ptr<Layer>> layers;
     map<string, shared_ptr<Chunk>> chunks;
     map<string, shared_ptr<Chunk>> params;
     for (const json& j_layer: j_net["layers"]) {
         string layer_id = j_layer["layer_id"].get<string>();
-        layers[layer_id] = parse_layer(j_layer, params);
+        layers[layer_id] = parse_layer(j_layer, params, blobs);
         for (const json& j_chunk: j_layer["chunks_in"]) {
             string chunk_id = j_chunk["chunk_id"].get<string>();
             if (chunks.find(chunk_id) == chunks.end()) {
@@ -0,0 +1,54 @@
+#include <iostream>
+#include <cmath>
+#include <string.h>
+#include "adamoptimizer.h"
+#include "util.h"
+
+using namespace micronet;
+
+// Trains the same weights with fp32, bf16 and int8 Adam state and checks the
+// compact runs stay close to fp32. The first block mixes a large alternating
+// gradient with small steady ones, the rest get noisy gradients.
+vector<float> train(const string& precision, int count, int steps) {
+    AdamOptimizer optimizer(1e-3, vector<float>{}, 0.9, 0.999, precision);
+    optimizer.total_iters_ = steps;
+    auto param = make_shared<Chunk>(count, 1, 1, 1);
+    vector<float> noise(count);
+    for (int iter = 1; iter <= steps; ++iter) {
+        float* diff = param->diff();
+        normal_random_init(count, noise.data(), 0.0f, 1.0f, iter);
+        diff[0] = iter % 2? 1.0f: -1.0f;
+        for (int i = 1; i < STATE_BLOCK; ++i) {
+            diff[i] = 3e-6f * i;
+        }
+        for (int i = STATE_BLOCK; i < count; ++i) {
+            diff[i] = 1e-2f * (i % 5) + 1e-2f * noise[i];
+        }
+        optimizer.optimize(param, iter);
+    }
+    return vector<float>(param->const_data(), param->const_data() + count);
+}
+
+int main() {
+    const int count = 4 * STATE_BLOCK;
+    const int steps = 2000;
+    vector<float> fp32 = train("fp32", count, steps);
+    for (const string& precision: {"bf16", "int8"}) {
+        vector<float> compact = train(precision, count, steps);
+        float tolerance = precision == "bf16"? 0.05f: 0.15f;
+        for (int i = 0; i < count; ++i) {
+            float error = std::fabs(compact[i] - fp32[i]);
+            // gradients 1e5 times below the largest of their int8 block sit
+            // on its first levels, they only have to stay in bounds
+            bool ok = i < STATE_BLOCK && precision == "int8"?
+                      std::fabs(compact[i]) <= 1.5f * std::fabs(fp32[i]) + 1e-2f:
+                      error <= tolerance * std::fabs(fp32[i]) + 1e-2f;
+            if (!ok) {
+                cout << precision << " weight " << i << ": " << compact[i] << ", fp32: " << fp32[i] << endl;
+                exit(1);
+            }
+        }
+        cout << precision << " adam state matches fp32" << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,39 @@
+#include <iostream>
+#include <cmath>
+#include <unistd.h>
+#include "micronet.h"
+
+using namespace micronet;
+
+chunk_ptr lenet(const chunk_ptr& img) {
+    auto conv = Convolution(3, 3, 1, 1, 8, "same")(img);
+    auto relu = Activation("relu")(conv);
+    auto pool = Pooling(2, 2, 2, 2)(relu);
+    return Dense(10)(pool);
+}
+
+// Hogwild workers load their batches through transforms, which run a
+// parallel_for of their own while other workers wait to take a batch. The
+// alarm turns a deadlock into a failure.
+int main() {
+    alarm(120);
+    set_num_threads(8);
+    map<string, data_t> data;
+    for (int i = 0; i < 512; ++i) {
+        vector<float> img(64);
+        normal_random_init(64, img.data(), (i % 10) * 0.1f, 1.0f, i + 1);
+        data["img"].push_back(img);
+        data["label"].push_back({float(i % 10)});
+    }
+    ClassifyNet net(lenet, {8, 8, 1});
+    net.set_optimizer(make_shared<SGDOptimizer>(0.01, vector<float>{0.5}));
+    net.set_transforms("img", "img", {1, 8, 8}, {make_shared<RandomFlip>(), make_shared<RandomCrop>(8, 8, 1)});
+    net.set_hogwild(4);
+    net.fit(data, data, 16, 3, 1000, true);
+    if (net.hogwild_stats().updates != 512 / 16) {
+        cout << "hogwild ran " << net.hogwild_stats().updates << " updates, expected " << 512 / 16 << endl;
+        return 1;
+    }
+    cout << "hogwild training with transforms finished" << endl;
+    return 0;
+}